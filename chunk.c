@@ -23,8 +23,11 @@ THE SOFTWARE.
 ******************************************************************************/
 
 #include <assert.h>
+#include <errno.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -33,6 +36,24 @@ THE SOFTWARE.
 #include "state.h"
 #include "thread.h"
 
+/**
+ * Upper bound on the number of primes below x. Dusart showed that
+ * pi(x) <= x / ln x * ( 1 + 1.2762 / ln x ) for every x > 1
+ * @param x
+ * @return Number of primes the output must hold
+ */
+uint64_t chunks_bound( uint64_t x )
+{
+  double l;
+
+  if ( x < 3 )
+    return 1;
+
+  /* The slack covers the rounding of the doubles */
+  l = log( (double)x );
+  return (uint64_t)( (double)x / l * ( 1.0 + 1.2762 / l ) ) + 64;
+}
+
 void chunks_create( struct state * s )
 {
   struct chunks * c;
@@ -43,8 +64,10 @@ void chunks_create( struct state * s )
     return;
   }
 
-  /* Prepares the output file for the primes */
-  c->primes_capacity = s->chunk_size << 4;
+  /* The output is reserved for every prime of the range up front,
+   * so it is never remapped while workers read or append to it
+   */
+  c->primes_capacity = chunks_bound( (uint64_t)s->chunk_count * s->chunk_size * 16 );
   c->primes_count = 0;
   c->primes_size = c->primes_capacity * sizeof( uint64_t );
   if ( ( c->primes_fd = open( s->primes_file, O_CREAT |
@@ -53,21 +76,23 @@ void chunks_create( struct state * s )
     state_error( s, "Cannot open file '%s'", s->primes_file );
   }
 
-  lseek( c->primes_fd, c->primes_size - 1, SEEK_SET );
-  if ( write( c->primes_fd, &zero, 1 ) != 1 )
+  if ( fallocate( c->primes_fd, 0, 0, c->primes_size ) < 0 &&
+       ( errno != EOPNOTSUPP ||
+         ftruncate( c->primes_fd, c->primes_size ) < 0 ) )
   {
-    state_error( s, "Cannot resize file '%s'", s->primes_file );
+    state_error( s, "Cannot reserve %llu bytes for '%s'",
+                 (unsigned long long)c->primes_size, s->primes_file );
   }
-  lseek( c->primes_fd, 0, SEEK_SET );
 
   /* Create the index which will store the address of the
    * first prime in the output array
    */
-  c->primes_index = (uint64_t*)malloc( sizeof(uint64_t) * s->chunk_count );
+  c->primes_index = (uint64_t*)malloc( sizeof(uint64_t) * ( s->chunk_count + 2 ) );
   if ( !c->primes_index )
   {
     state_error( s, "Cannot create index" );
   }
+  memset( c->primes_index, 0, sizeof(uint64_t) * ( s->chunk_count + 2 ) );
 
   /* mmap the output file */
   if ( ( c->primes_data = mmap( 0, c->primes_size, PROT_READ | PROT_WRITE,
@@ -85,7 +110,7 @@ void chunks_create( struct state * s )
     state_error( s, "Cannot open chunk cache '%s'", s->sieve_file );
   }
 
-  lseek( c->sieve_fd, c->sieve_size - 1, SEEK_SET );
+  lseek( c->sieve_fd, SIEVE_HEADER_SIZE + c->sieve_size - 1, SEEK_SET );
   if ( write( c->sieve_fd, &zero, 1 ) != 1 )
   {
     state_error( s, "Cannot resize file '%s'", s->sieve_file );
@@ -93,11 +118,20 @@ void chunks_create( struct state * s )
   lseek( c->sieve_fd, 0, SEEK_SET );
 
   /* mmap the chunk cache */
-  if ( ( c->sieve_data = mmap( 0, c->sieve_size, PROT_READ | PROT_WRITE,
-                               MAP_SHARED, c->sieve_fd, 0 ) ) == MAP_FAILED )
+  if ( ( c->sieve_header = mmap( 0, SIEVE_HEADER_SIZE + c->sieve_size,
+                                 PROT_READ | PROT_WRITE, MAP_SHARED,
+                                 c->sieve_fd, 0 ) ) == MAP_FAILED )
   {
+    c->sieve_header = NULL;
     state_error( s, "Cannot mmap file '%s'", s->sieve_file );
   }
+
+  /* Describe the bitmap so it can be read after the run */
+  memcpy( c->sieve_header->magic, SIEVE_MAGIC, sizeof( c->sieve_header->magic ) );
+  c->sieve_header->chunk_size = s->chunk_size;
+  c->sieve_header->chunk_count = c->sieve_chunks;
+  c->sieve_header->chunks_saved = 0;
+  c->sieve_data = (uint8_t*)c->sieve_header + SIEVE_HEADER_SIZE;
 }
 
 void chunks_destroy( struct state * s )
@@ -133,9 +167,10 @@ void chunks_destroy( struct state * s )
     c->primes_fd = -1;
   }
 
-  if ( c->sieve_data )
+  if ( c->sieve_header )
   {
-    munmap( c->sieve_data, c->sieve_size );
+    munmap( c->sieve_header, SIEVE_HEADER_SIZE + c->sieve_size );
+    c->sieve_header = NULL;
     c->sieve_data = NULL;
   }
 
@@ -149,41 +184,36 @@ void chunks_destroy( struct state * s )
 void chunks_write_prime( struct state * s, uint64_t prime )
 {
   struct chunks * c;
-  uint64_t * addr;
 
   if ( !( c = s->chunk_mngr ) )
     return;
 
-  /* Double the size of the output file */
-  if ( c->primes_count >= c->primes_capacity )
-  {
-    pthread_rwlock_wrlock( &s->thread_mngr->write_lock );
-
-    if ( ftruncate( c->primes_fd, c->primes_size << 1ull ) < 0 )
-    {
-      state_error( s, "Cannot resize output size" );
-    }
-
-    if ( ( addr = mremap( c->primes_data, c->primes_size,
-                          c->primes_size << 1, MREMAP_MAYMOVE ) ) == MAP_FAILED )
-    {
-      state_error( s, "Cannot remap output file '%s'", s->primes_file );
-    }
+  assert( c->primes_count < c->primes_capacity );
+  c->primes_data[ __sync_fetch_and_add( &c->primes_count, 1 ) ] = prime;
+}
 
-    c->primes_data = addr;
-    c->primes_size <<= 1;
-    c->primes_capacity <<= 1;
+/**
+ * Appends a batch of primes to the output
+ * @param s
+ * @param primes
+ * @param count
+ */
+void chunks_write_primes( struct state * s, const uint64_t * primes,
+                          uint64_t count )
+{
+  struct chunks * c;
 
-    pthread_rwlock_unlock( &s->thread_mngr->write_lock );
-  }
+  if ( !( c = s->chunk_mngr ) || !count )
+    return;
 
-  c->primes_data[ __sync_fetch_and_add( &c->primes_count, 1 ) ] = prime;
+  assert( c->primes_count + count <= c->primes_capacity );
+  memcpy( c->primes_data + c->primes_count, primes, count * sizeof( uint64_t ) );
+  __sync_fetch_and_add( &c->primes_count, count );
 }
 
 uint64_t chunks_get_prime( struct state * s, uint64_t idx )
 {
   struct chunks * c;
-  uint64_t prime;
 
   if ( !( c = s->chunk_mngr ) )
   {
@@ -195,9 +225,30 @@ uint64_t chunks_get_prime( struct state * s, uint64_t idx )
     state_error( s, "Invalid prime index" );
   }
 
-  pthread_rwlock_rdlock( &s->thread_mngr->write_lock );
-  prime = c->primes_data[ idx ];
-  pthread_rwlock_unlock( &s->thread_mngr->write_lock );
+  return c->primes_data[ idx ];
+}
+
+/**
+ * Starts writing back a saved chunk and its primes, so the dirty
+ * pages of the mappings do not pile up against a memory limit
+ * @param s
+ * @param n Number of the chunk, starting from 1
+ */
+void chunks_flush( struct state * s, int n )
+{
+  struct chunks * c;
+  uint64_t first, end;
+
+  if ( !( c = s->chunk_mngr ) )
+    return;
+
+  sync_file_range( c->sieve_fd, SIEVE_HEADER_SIZE + ( n - 1 ) * s->chunk_size,
+                   s->chunk_size, SYNC_FILE_RANGE_WRITE );
 
-  return prime;
+  first = c->primes_index[ n ];
+  end = c->primes_index[ n + 1 ];
+  if ( end > first )
+    sync_file_range( c->primes_fd, first * sizeof( uint64_t ),
+                     ( end - first ) * sizeof( uint64_t ),
+                     SYNC_FILE_RANGE_WRITE );
 }
@@ -27,8 +27,29 @@ THE SOFTWARE.
 
 #include <stdint.h>
 
+/* Size of the header in front of the sieve bitmap, keeps it page aligned */
+#define SIEVE_HEADER_SIZE 4096
+
+/* Identifies sieve files */
+#define SIEVE_MAGIC "PRIMESV1"
+
 struct state;
 
+struct sieve_header
+{
+  /* SIEVE_MAGIC, without the terminator */
+  char magic[ 8 ];
+
+  /* Size of a chunk in bytes */
+  uint64_t chunk_size;
+
+  /* Number of chunks in the file */
+  uint64_t chunk_count;
+
+  /* Number of chunks sieved and saved, these are always the first ones */
+  uint64_t chunks_saved;
+};
+
 struct chunks
 {
   /* File descriptor of the output */
@@ -40,13 +61,15 @@ struct chunks
   /* Number of primes written */
   uint64_t primes_count;
 
-  /* Available storage for primes */
+  /* Available storage for primes, an upper bound on pi(x) */
   uint64_t primes_capacity;
 
   /* Size of the primes file in bytes */
   size_t primes_size;
 
-  /* Maps the index of the first prime in each chunk */
+  /* Maps the index of the first prime in each chunk, the primes
+   * of chunk n are stored between primes_index[n] and primes_index[n + 1]
+   */
   uint64_t * primes_index;
 
   /* File descriptor of the sieve */
@@ -55,17 +78,23 @@ struct chunks
   /* Number of chunks stored */
   uint64_t sieve_chunks;
 
-  /* Size of the sieve cache */
+  /* Size of the sieve cache, without the header */
   size_t sieve_size;
 
+  /* Header of the sieve file, the bitmap follows it */
+  struct sieve_header * sieve_header;
+
   /* Individual bits accessed by the sieve */
   uint8_t * sieve_data;
 };
 
+uint64_t chunks_bound( uint64_t x );
 void     chunks_create( struct state * );
 void     chunks_destroy( struct state * );
 void     chunks_write_prime( struct state *, uint64_t );
+void     chunks_write_primes( struct state *, const uint64_t *, uint64_t );
 uint64_t chunks_get_prime( struct state *, uint64_t );
+void     chunks_flush( struct state *, int n );
 
 #endif
 
@@ -0,0 +1,249 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "gap.h"
+#include "state.h"
+#include "thread.h"
+
+/**
+ * Allocates the histograms and chunk records
+ * @param s
+ */
+void gaps_create( struct state * s )
+{
+  struct gaps * g;
+  size_t sz;
+  int i;
+
+  if ( !( g = s->gap_mngr ) || !s->gaps_file )
+    return;
+
+  /* One histogram for every worker */
+  g->histogram_count = s->thread_count;
+  sz = sizeof( uint64_t* ) * g->histogram_count;
+  assert( g->histograms = (uint64_t**)malloc( sz ) );
+  for ( i = 0; i < g->histogram_count; ++i )
+  {
+    sz = sizeof( uint64_t ) * GAPS_MAX;
+    assert( g->histograms[ i ] = (uint64_t*)malloc( sz ) );
+    memset( g->histograms[ i ], 0, sz );
+  }
+
+  /* Chunks are numbered from 1 */
+  sz = sizeof( struct gap_chunk ) * ( s->chunk_count + 1 );
+  assert( g->chunks = (struct gap_chunk*)malloc( sz ) );
+  memset( g->chunks, 0, sz );
+}
+
+/**
+ * Frees the histograms and chunk records
+ * @param s
+ */
+void gaps_destroy( struct state * s )
+{
+  struct gaps * g;
+  int i;
+
+  if ( !( g = s->gap_mngr ) )
+    return;
+
+  if ( g->histograms )
+  {
+    for ( i = 0; i < g->histogram_count; ++i )
+    {
+      free( g->histograms[ i ] );
+    }
+
+    free( g->histograms );
+    g->histograms = NULL;
+  }
+
+  if ( g->chunks )
+  {
+    for ( i = 0; i <= s->chunk_count; ++i )
+    {
+      free( g->chunks[ i ].records );
+    }
+
+    free( g->chunks );
+    g->chunks = NULL;
+  }
+}
+
+/**
+ * Appends a local record to a chunk
+ * @param c
+ * @param prime
+ * @param gap
+ */
+static void gaps_record( struct gap_chunk * c, uint64_t prime, uint64_t gap )
+{
+  size_t sz;
+
+  if ( c->record_count >= c->record_capacity )
+  {
+    c->record_capacity = c->record_capacity ? c->record_capacity << 1 : 16;
+    sz = sizeof( struct gap_record ) * c->record_capacity;
+    assert( c->records = (struct gap_record*)realloc( c->records, sz ) );
+  }
+
+  c->records[ c->record_count ].prime = prime;
+  c->records[ c->record_count ].gap = gap;
+  c->record_count++;
+}
+
+/**
+ * Analyses the gaps inside a saved chunk. Gaps crossing the
+ * boundary of the chunk are handled in gaps_write
+ * @param s
+ * @param thread Index of the calling thread
+ * @param n      Chunk number
+ */
+void gaps_chunk( struct state * s, int thread, int n )
+{
+  struct gaps * g;
+  struct chunks * c;
+  struct gap_chunk * gc;
+  uint64_t * hist;
+  uint64_t i, first, end, prev, prime, gap, best;
+
+  if ( !( g = s->gap_mngr ) || !g->histograms || !( c = s->chunk_mngr ) )
+    return;
+
+  gc = &g->chunks[ n ];
+  hist = g->histograms[ thread ];
+
+  first = c->primes_index[ n ];
+  end = c->primes_index[ n + 1 ];
+
+  gc->count = end - first;
+  if ( gc->count > 0 )
+  {
+    prev = gc->first = c->primes_data[ first ];
+    best = 0;
+
+    for ( i = first + 1; i < end; ++i )
+    {
+      prime = c->primes_data[ i ];
+      gap = prime - prev;
+
+      hist[ gap < GAPS_MAX ? gap : GAPS_MAX - 1 ]++;
+      if ( gap > best )
+      {
+        gaps_record( gc, prev, gap );
+        best = gap;
+      }
+
+      prev = prime;
+    }
+
+    gc->last = prev;
+  }
+}
+
+/**
+ * Merges the histograms, stitches the chunks together
+ * and writes the results to the gaps file
+ * @param s
+ */
+void gaps_write( struct state * s )
+{
+  struct gaps * g;
+  struct gap_chunk * gc;
+  uint64_t hist[ GAPS_MAX ];
+  uint64_t last, gap, best;
+  FILE * f;
+  int i, n;
+
+  if ( !( g = s->gap_mngr ) || !g->histograms )
+    return;
+
+  if ( !( f = fopen( s->gaps_file, "w" ) ) )
+  {
+    state_error( s, "Cannot open file '%s'", s->gaps_file );
+  }
+
+  memset( hist, 0, sizeof( hist ) );
+  for ( i = 0; i < g->histogram_count; ++i )
+  {
+    for ( n = 0; n < GAPS_MAX; ++n )
+    {
+      hist[ n ] += g->histograms[ i ][ n ];
+    }
+  }
+
+  /* Records must be visited in order: a local record is a
+   * global one only if it beats everything before its chunk
+   */
+  fprintf( f, "# record <prime> <gap>\n" );
+  last = 0ull, best = 0ull;
+  for ( n = 1; n <= s->chunk_count; ++n )
+  {
+    gc = &g->chunks[ n ];
+    if ( gc->count == 0 )
+      continue;
+
+    if ( last )
+    {
+      gap = gc->first - last;
+      hist[ gap < GAPS_MAX ? gap : GAPS_MAX - 1 ]++;
+      if ( gap > best )
+      {
+        fprintf( f, "record %llu %llu\n", (unsigned long long)last,
+                 (unsigned long long)gap );
+        best = gap;
+      }
+    }
+
+    for ( i = 0; i < gc->record_count; ++i )
+    {
+      if ( gc->records[ i ].gap > best )
+      {
+        fprintf( f, "record %llu %llu\n",
+                 (unsigned long long)gc->records[ i ].prime,
+                 (unsigned long long)gc->records[ i ].gap );
+        best = gc->records[ i ].gap;
+      }
+    }
+
+    last = gc->last;
+  }
+
+  fprintf( f, "# gap <size> <count>\n" );
+  for ( n = 0; n < GAPS_MAX; ++n )
+  {
+    if ( hist[ n ] )
+    {
+      fprintf( f, "gap %d%s %llu\n", n, n == GAPS_MAX - 1 ? "+" : "",
+               (unsigned long long)hist[ n ] );
+    }
+  }
+
+  fclose( f );
+}
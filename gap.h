@@ -0,0 +1,78 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef GAP_H
+#define GAP_H
+
+#include <stdint.h>
+
+/* Gaps larger than this are counted in the last bucket */
+#define GAPS_MAX 2048
+
+struct state;
+
+struct gap_record
+{
+  /* Prime starting the gap */
+  uint64_t prime;
+
+  /* Distance to the next prime */
+  uint64_t gap;
+};
+
+struct gap_chunk
+{
+  /* Number of primes in the chunk */
+  uint64_t count;
+
+  /* First prime of the chunk */
+  uint64_t first;
+
+  /* Last prime of the chunk */
+  uint64_t last;
+
+  /* Gaps larger than every previous gap inside the chunk */
+  struct gap_record * records;
+  int record_count;
+  int record_capacity;
+};
+
+struct gaps
+{
+  /* Gap histogram of every thread */
+  uint64_t ** histograms;
+
+  /* Number of histograms */
+  int histogram_count;
+
+  /* Boundaries and local records of each chunk */
+  struct gap_chunk * chunks;
+};
+
+void gaps_create( struct state * );
+void gaps_destroy( struct state * );
+void gaps_chunk( struct state *, int thread, int n );
+void gaps_write( struct state * );
+
+#endif
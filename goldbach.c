@@ -0,0 +1,201 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "goldbach.h"
+#include "state.h"
+#include "thread.h"
+
+/**
+ * Allocates the results if a report was requested
+ * @param s
+ */
+void goldbach_create( struct state * s )
+{
+  struct goldbach * g;
+  size_t sz;
+  int i;
+
+  if ( !( g = s->goldbach_mngr ) || !s->goldbach_file )
+    return;
+
+  sz = sizeof( struct goldbach_chunk ) * ( s->chunk_count + 1 );
+  assert( g->chunks = (struct goldbach_chunk*)malloc( sz ) );
+  memset( g->chunks, 0, sz );
+  for ( i = 1; i <= s->chunk_count; ++i )
+  {
+    g->chunks[ i ].state = s;
+    g->chunks[ i ].n = i;
+  }
+}
+
+/**
+ * Frees the results
+ * @param s
+ */
+void goldbach_destroy( struct state * s )
+{
+  struct goldbach * g;
+
+  if ( !( g = s->goldbach_mngr ) || !g->chunks )
+    return;
+
+  free( g->chunks );
+  g->chunks = NULL;
+}
+
+/**
+ * Reads 64 bits of the sieve starting at any bit, bits before the
+ * start of the sieve read as composite
+ * @param bits
+ * @param start Index of the first bit, might be negative
+ * @return Word with a bit set for every prime
+ */
+static inline uint64_t goldbach_primes( const uint8_t * bits, int64_t start )
+{
+  uint64_t word, next;
+  int shift;
+
+  if ( start < 0 )
+    return start <= -64 ? 0 : goldbach_primes( bits, 0 ) << -start;
+
+  memcpy( &word, bits + ( start >> 3 ), sizeof( word ) );
+  if ( ( shift = start & 7 ) )
+  {
+    next = bits[ ( start >> 3 ) + 8 ];
+    word = ( word >> shift ) | ( next << ( 64 - shift ) );
+  }
+
+  return ~word;
+}
+
+/**
+ * Finds the smallest prime p for every even n of a chunk with n - p
+ * prime. For 64 even numbers 2k, 2k - p is prime exactly where the
+ * sieve bits from k - ( p + 1 ) / 2 are clear, so every prime settles
+ * a whole word of numbers at once
+ * @param gp Chunk pointer
+ */
+static void goldbach_chunk( void * gp )
+{
+  struct goldbach_chunk * g = (struct goldbach_chunk*)gp;
+  struct state * s = g->state;
+  struct chunks * c = s->chunk_mngr;
+  uint64_t k, first, last, open, found, n, p, i, bit;
+
+  first = ( g->n - 1 ) * s->chunk_size * 8;
+  last = g->n * s->chunk_size * 8;
+
+  for ( k = first; k < last; k += 64 )
+  {
+    /* 0 and 2 are not checked, 4 = 2 + 2 is the only sum with 2 */
+    open = ~0ull;
+    if ( k == 0 )
+    {
+      open &= ~7ull;
+      g->worst_n = 4;
+      g->worst_p = 2;
+    }
+
+    for ( i = 1; open && i < c->primes_count; ++i )
+    {
+      p = c->primes_data[ i ];
+      if ( p > 2 * ( k + 63 ) )
+        break;
+
+      found = open & goldbach_primes( c->sieve_data,
+                                      (int64_t)k - (int64_t)( ( p + 1 ) >> 1 ) );
+      open &= ~found;
+
+      /* Primes are tried in increasing order, the last one is the worst */
+      if ( found && p > g->worst_p )
+      {
+        bit = __builtin_ctzll( found );
+        g->worst_p = p;
+        g->worst_n = 2 * ( k + bit );
+      }
+    }
+
+    for ( ; open; open &= open - 1 )
+    {
+      n = 2 * ( k + __builtin_ctzll( open ) );
+      if ( !g->failures++ )
+        g->failure = n;
+    }
+  }
+}
+
+/**
+ * Checks every even number covered by the sieve in parallel
+ * and writes the worst case of each chunk to the report
+ * @param s
+ */
+void goldbach_run( struct state * s )
+{
+  struct goldbach * g;
+  struct goldbach_chunk * gc, * worst;
+  uint64_t failures;
+  FILE * f;
+  int i;
+
+  if ( !( g = s->goldbach_mngr ) || !g->chunks )
+    return;
+
+  threads_map( s, g->chunks + 1, sizeof( struct goldbach_chunk ),
+               s->chunk_count, goldbach_chunk );
+
+  if ( !( f = fopen( s->goldbach_file, "w" ) ) )
+  {
+    state_error( s, "Cannot open Goldbach report '%s'", s->goldbach_file );
+  }
+
+  worst = NULL;
+  failures = 0;
+  for ( i = 1; i <= s->chunk_count; ++i )
+  {
+    gc = &g->chunks[ i ];
+    fprintf( f, "chunk %d %llu %llu\n", i, (unsigned long long)gc->worst_n,
+             (unsigned long long)gc->worst_p );
+    if ( gc->failures )
+      fprintf( f, "fail %llu %llu\n", (unsigned long long)gc->failure,
+               (unsigned long long)gc->failures );
+
+    failures += gc->failures;
+    if ( !worst || gc->worst_p > worst->worst_p )
+      worst = gc;
+  }
+
+  fclose( f );
+
+  if ( !s->quiet )
+  {
+    printf( "goldbach: smallest prime is at most %llu, reached at %llu, "
+            "%llu failures\n", (unsigned long long)worst->worst_p,
+            (unsigned long long)worst->worst_n, (unsigned long long)failures );
+  }
+}
@@ -0,0 +1,63 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef GOLDBACH_H
+#define GOLDBACH_H
+
+#include <stdint.h>
+
+struct state;
+
+struct goldbach_chunk
+{
+  /* State of the run */
+  struct state * state;
+
+  /* Chunk checked, its even numbers are 2k for its odd indices k */
+  int n;
+
+  /* Even number needing the largest smallest prime in the chunk */
+  uint64_t worst_n;
+
+  /* Smallest prime p with worst_n - p prime */
+  uint64_t worst_p;
+
+  /* Even numbers above 2 which are not the sum of two primes */
+  uint64_t failures;
+
+  /* First of them, 0 if none */
+  uint64_t failure;
+};
+
+struct goldbach
+{
+  /* Results of every chunk, numbered from 1 */
+  struct goldbach_chunk * chunks;
+};
+
+void goldbach_create( struct state * );
+void goldbach_destroy( struct state * );
+void goldbach_run( struct state * );
+
+#endif
@@ -0,0 +1,232 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "iterator.h"
+#include "job.h"
+
+/**
+ * Extends the sieving primes until they cover sqrt(limit). The new
+ * primes are sieved with the old ones, which is possible as long as
+ * the limit at most squares in every step
+ * @param it
+ * @param limit
+ * @return 0 if out of memory
+ */
+static int primes_iterator_grow( struct primes_iterator * it, uint64_t limit )
+{
+  uint64_t first, count, next, i, bytes;
+  uint32_t * base;
+  uint8_t * bits;
+
+  while ( it->base_limit < UINT32_MAX &&
+          it->base_limit * it->base_limit < limit )
+  {
+    next = it->base_limit << 1ull;
+    if ( next > UINT32_MAX )
+      next = UINT32_MAX;
+
+    /* Odd numbers in [base_limit, next) */
+    first = it->base_limit >> 1ull;
+    count = ( next >> 1ull ) - first;
+    bytes = ( count + 7ull ) >> 3ull;
+    if ( !( bits = (uint8_t*)malloc( bytes ) ) )
+      return 0;
+    memset( bits, 0, bytes );
+
+    for ( i = 0; i < it->base_count; ++i )
+    {
+      jobs_cross_out( bits, first, count, it->base[ i ] );
+    }
+
+    for ( i = 0; i < count; ++i )
+    {
+      if ( bits[ i >> 3ull ] & ( 1 << ( i & 7ull ) ) )
+        continue;
+
+      if ( it->base_count >= it->base_capacity )
+      {
+        it->base_capacity <<= 1ull;
+        base = (uint32_t*)realloc( it->base,
+                                   it->base_capacity * sizeof( uint32_t ) );
+        if ( !base )
+        {
+          free( bits );
+          return 0;
+        }
+        it->base = base;
+      }
+
+      it->base[ it->base_count++ ] = (uint32_t)( ( ( first + i ) << 1ull ) + 1ull );
+    }
+
+    free( bits );
+    it->base_limit = next;
+  }
+
+  return 1;
+}
+
+/**
+ * Sieves the segment starting at it->first
+ * @param it
+ * @return 0 if out of memory
+ */
+static int primes_iterator_sieve( struct primes_iterator * it )
+{
+  uint64_t count, high, i;
+
+  count = ITERATOR_SEGMENT << 3ull;
+  if ( it->first >= ( UINT64_MAX >> 1ull ) - count )
+  {
+    /* The last segment ends at 2^64 */
+    count = ( UINT64_MAX >> 1ull ) - it->first + 1ull;
+  }
+
+  high = ( ( it->first + count - 1ull ) << 1ull ) + 1ull;
+  if ( !primes_iterator_grow( it, high ) )
+    return 0;
+
+  memset( it->segment, 0, ITERATOR_SEGMENT );
+  for ( i = 0; i < it->base_count &&
+              (uint64_t)it->base[ i ] * it->base[ i ] <= high; ++i )
+  {
+    jobs_cross_out( it->segment, it->first, count, it->base[ i ] );
+  }
+
+  /* Mark the tail of a partial segment and the number 1 */
+  for ( i = count; i < ITERATOR_SEGMENT << 3ull; ++i )
+  {
+    it->segment[ i >> 3ull ] |= 1 << ( i & 7ull );
+  }
+  if ( it->first == 0ull )
+  {
+    it->segment[ 0 ] |= 1;
+  }
+
+  it->pos = 0ull;
+  return 1;
+}
+
+/**
+ * Prepares an iterator returning the primes >= start
+ * @param it
+ * @param start
+ * @return 0 if out of memory
+ */
+int primes_iterator_init( struct primes_iterator * it, uint64_t start )
+{
+  memset( it, 0, sizeof( *it ) );
+
+  it->base_capacity = 1024;
+  it->segment = (uint8_t*)malloc( ITERATOR_SEGMENT );
+  it->base = (uint32_t*)malloc( it->base_capacity * sizeof( uint32_t ) );
+  if ( !it->segment || !it->base )
+  {
+    primes_iterator_destroy( it );
+    return 0;
+  }
+
+  /* Seed the sieving primes, these cover everything below 9 */
+  it->base[ 0 ] = 3;
+  it->base[ 1 ] = 5;
+  it->base[ 2 ] = 7;
+  it->base_count = 3;
+  it->base_limit = 8;
+
+  it->two = start <= 2ull;
+
+  /* Segments are aligned to their size */
+  it->first = ( start >> 1ull ) & ~( ( (uint64_t)ITERATOR_SEGMENT << 3ull ) - 1ull );
+  if ( !primes_iterator_sieve( it ) )
+  {
+    primes_iterator_destroy( it );
+    return 0;
+  }
+
+  it->pos = ( start >> 1ull ) - it->first;
+  return 1;
+}
+
+/**
+ * Returns the next prime
+ * @param it
+ * @return Next prime, 0 past the last prime below 2^64 or out of memory
+ */
+uint64_t primes_iterator_next( struct primes_iterator * it )
+{
+  uint64_t count, word;
+
+  if ( it->two )
+  {
+    it->two = 0;
+    return 2ull;
+  }
+
+  count = ITERATOR_SEGMENT << 3ull;
+  while ( !it->done )
+  {
+    /* Skip composite bits a byte at a time */
+    while ( it->pos < count )
+    {
+      if ( !( it->pos & 7ull ) && it->segment[ it->pos >> 3ull ] == 0xFF )
+      {
+        it->pos += 8ull;
+        continue;
+      }
+
+      word = it->pos++;
+      if ( !( it->segment[ word >> 3ull ] & ( 1 << ( word & 7ull ) ) ) )
+        return ( ( it->first + word ) << 1ull ) + 1ull;
+    }
+
+    if ( it->first + count > ( UINT64_MAX >> 1ull ) ||
+         !( it->first += count, primes_iterator_sieve( it ) ) )
+    {
+      it->done = 1;
+    }
+  }
+
+  return 0ull;
+}
+
+/**
+ * Frees the iterator
+ * @param it
+ */
+void primes_iterator_destroy( struct primes_iterator * it )
+{
+  if ( it->segment )
+  {
+    free( it->segment );
+    it->segment = NULL;
+  }
+
+  if ( it->base )
+  {
+    free( it->base );
+    it->base = NULL;
+  }
+}
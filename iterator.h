@@ -0,0 +1,67 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef ITERATOR_H
+#define ITERATOR_H
+
+#include <stdint.h>
+
+/* Size of the segment sieved at once, in bytes */
+#define ITERATOR_SEGMENT ( 32 << 10 )
+
+struct primes_iterator
+{
+  /* Index of the first odd number in the segment */
+  uint64_t first;
+
+  /* Position of the next bit to examine in the segment */
+  uint64_t pos;
+
+  /* Bitmap of the current segment, bit i stands for 2*(first+i)+1 */
+  uint8_t * segment;
+
+  /* Odd primes used for sieving */
+  uint32_t * base;
+
+  /* Number of sieving primes */
+  uint64_t base_count;
+
+  /* Allocated space for sieving primes */
+  uint64_t base_capacity;
+
+  /* Every prime below this limit is a sieving prime */
+  uint64_t base_limit;
+
+  /* Set if 2 still has to be returned */
+  int two;
+
+  /* Set once the iterator ran past 2^64 */
+  int done;
+};
+
+int      primes_iterator_init( struct primes_iterator *, uint64_t start );
+uint64_t primes_iterator_next( struct primes_iterator * );
+void     primes_iterator_destroy( struct primes_iterator * );
+
+#endif
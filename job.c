@@ -27,9 +27,15 @@ THE SOFTWARE.
 #include <stdint.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <math.h>
 #include <string.h>
 #include "job.h"
 #include "chunk.h"
+#include "iterator.h"
+#include "kernel.h"
+#include "metrics.h"
+#include "rank.h"
+#include "spf.h"
 #include "state.h"
 #include "thread.h"
 
@@ -41,55 +47,180 @@ struct column
   int done;
 };
 
-void cross_out (struct state *, uint64_t);
-
 /**
- * Run the first job
+ * Collects the primes needed to sieve chunk 1
+ * @param s
  */
-void startup_job( struct state * s )
+void jobs_base_primes( struct state * s )
 {
-  uint8_t * bitset;
-  uint64_t limit, i, j;
-  struct chunks * c;
+  struct primes_iterator it;
+  struct jobs * j;
+  uint64_t limit, p, capacity;
 
-  if ( !( c = s->chunk_mngr ) )
-      return;
+  j = s->job_mngr;
+  limit = s->chunk_size << 4ull;
 
-  /* Allocate a separate bitset so we don't overwrite stuff */
-  assert( bitset = (uint8_t*)malloc( s->chunk_size ) );
-  memset( bitset, 0, s->chunk_size );
+  if ( !primes_iterator_init( &it, 3ull ) )
+  {
+    state_error( s, "Cannot create iterator" );
+  }
 
-  limit = s->chunk_size << 4;
-  for ( i = 1; i * ( i + 1ull ) << 1ull < limit; ++i )
+  capacity = 64;
+  assert( j->base = (uint64_t*)malloc( sizeof( uint64_t ) * capacity ) );
+  j->base_count = 0;
+  while ( ( p = primes_iterator_next( &it ) ) && p * p < limit )
   {
-    if ( ! ( bitset[ i >> 3ull ] & ( 1 << ( i & 7 ) ) ) )
+    if ( j->base_count >= capacity )
     {
-      for ( j = i * ( i + 1ull ) << 1ull;
-            ( j << 1ull ) + 1ull < limit;
-            j += ( i << 1ull ) + 1ull )
-      {
-        bitset[ j >> 3ull ] |= 1ull << ( j & 7ull );
-      }
+      capacity <<= 1;
+      assert( j->base = (uint64_t*)realloc( j->base,
+                                            sizeof( uint64_t ) * capacity ) );
     }
+
+    j->base[ j->base_count++ ] = p;
   }
 
-  chunks_write_prime( s, 2 );
-  for ( i = 1ull; ( i << 1ull ) + 1ull < limit; ++i )
+  primes_iterator_destroy( &it );
+}
+
+/**
+ * Sieves a segment of chunk 1 with the base primes. The segments
+ * of chunk 1 do not depend on anything, so they are handed out to
+ * all threads as soon as the pool starts
+ * @param s
+ * @param segment Index of the segment, starting from 0
+ */
+void jobs_run_bootstrap( struct state * s, int segment )
+{
+  struct jobs * j;
+  struct chunks * c;
+  uint64_t first, count, bytes, i;
+  int spf;
+
+  j = s->job_mngr;
+  c = s->chunk_mngr;
+  spf = s->spf_mngr && s->spf_mngr->data;
+
+  bytes = ( s->chunk_size + j->boot_segments - 1 ) / j->boot_segments;
+  bytes = ( bytes + 63ull ) & ~63ull;
+  if ( ( first = bytes * segment ) >= s->chunk_size )
+    return;
+  if ( first + bytes > s->chunk_size )
+    bytes = s->chunk_size - first;
+
+  first <<= 3ull;
+  count = bytes << 3ull;
+  if ( s->algorithm == JOBS_ATKIN )
   {
-    if ( ! ( bitset[ i >> 3ull ] & ( 1ull << ( i & 7ull ) ) ) )
-    {
-      chunks_write_prime( s, ( i << 1ull ) + 1ull );
-    }
+    jobs_atkin( c->sieve_data + ( first >> 3ull ), first, count );
+
+    /* 3 is not generated by any of the quadratic forms */
+    if ( first == 0 )
+      c->sieve_data[ 0 ] &= ~2;
+  }
+
+  for ( i = 0; i < j->base_count; ++i )
+  {
+    if ( s->algorithm == JOBS_ATKIN )
+      jobs_cross_out_square( c->sieve_data + ( first >> 3ull ), first, count,
+                             j->base[ i ] );
+    else
+      s->kernel->cross_out( c->sieve_data + ( first >> 3ull ), first, count,
+                            j->base[ i ] );
+    if ( spf )
+      spf_cross_out( s, first, count, j->base[ i ] );
+  }
+}
+
+/**
+ * Integer square root
+ * @param n
+ */
+static uint64_t jobs_isqrt( uint64_t n )
+{
+  uint64_t r;
+
+  for ( r = (uint64_t)sqrt( (double)n ); r && r > n / r; --r );
+  while ( ( r + 1 ) <= n / ( r + 1 ) )
+    ++r;
+
+  return r;
+}
+
+/**
+ * Finds the chunk holding the square root of the last number in a chunk,
+ * the Sieve of Atkin needs the primes up to that one
+ * @param s
+ * @param n Index of the chunk
+ */
+static int jobs_atkin_divider( struct state * s, int n )
+{
+  uint64_t root;
+
+  root = jobs_isqrt( n * s->chunk_size * 16 - 1 );
+  return (int)( ( root >> 1 ) / ( s->chunk_size * 8 ) ) + 1;
+}
+
+/**
+ * Sets up the jobs of a chunk. With Eratosthenes, every chunk before
+ * it is a divider. With Atkin, the chunk is a single job, which waits
+ * for the chunk holding its square root: the counters start one below
+ * that divider, so jobs_next hands it out once the divider is saved
+ * @param s
+ * @param col
+ * @param n
+ */
+static void jobs_column( struct state * s, struct column * col, int n )
+{
+  col->n = n;
+  if ( s->algorithm == JOBS_ATKIN )
+  {
+    col->all = jobs_atkin_divider( s, n );
+    col->working = col->done = col->all - 1;
+  }
+  else
+  {
+    col->all = n - 1;
+    col->working = col->done = 0;
   }
+}
 
-  free( bitset );
+/**
+ * Sieves a whole chunk with the Sieve of Atkin, eliminating squares
+ * with the saved primes up to the square root of the chunk
+ * @param s
+ * @param n Index of the chunk
+ */
+static void jobs_run_atkin( struct state * s, int n )
+{
+  struct chunks * c;
+  uint64_t first, count, last, p, i;
+  int spf;
+
+  c = s->chunk_mngr;
+  spf = s->spf_mngr && s->spf_mngr->data;
 
-  c->primes_index[1] = 0;
-  c->primes_index[2] = c->primes_count;
+  first = ( n - 1 ) * s->chunk_size * 8;
+  count = s->chunk_size * 8;
+  last = ( first + count ) * 2;
 
+  jobs_atkin( c->sieve_data + ( first >> 3ull ), first, count );
 
-  printf("finshed startup job\n");
- }
+  /* Primes are saved in order, 2 comes first */
+  for ( i = 1; i < c->primes_count; ++i )
+  {
+    p = chunks_get_prime( s, i );
+    if ( p * p >= last )
+      break;
+
+    jobs_cross_out_square( c->sieve_data + ( first >> 3ull ), first, count, p );
+    if ( spf )
+      spf_cross_out( s, first, count, p );
+  }
+
+  if ( !s->quiet )
+    printf( "thread %lu sieved %d with atkin\n", (unsigned long)pthread_self(), n );
+}
 
 /**
  * Initialises the job manager
@@ -103,23 +234,30 @@ void jobs_create( struct state * s )
   if ( !( j = s->job_mngr ) )
     return;
 
-  /* Run the first job, chunk 1 */
-  startup_job( s );
+  /* Primes up to the square root of chunk 1 */
+  jobs_base_primes( s );
 
   /* Allocate storage for the queue */
-  sz = sizeof( struct column ) * 100;
+  j->columns = s->job_columns ? s->job_columns : JOBS_COLUMNS;
+  sz = sizeof( struct column ) * j->columns;
   assert( j->processed = (struct column*)malloc( sz ) );
   memset( j->processed, 0, sz );
-  for ( i = 0; i < 100; i++)
+  for ( i = 0; i < j->columns; i++)
   {
     j->processed[ i ].n = -1;
   }
 
+  /* Chunk 1 is split into segments which are its jobs */
+  j->boot_segments = (int)( ( s->chunk_size + JOBS_BOOT_SEGMENT - 1 ) /
+                            JOBS_BOOT_SEGMENT );
+  j->processed[ 0 ].n = 1;
+  j->processed[ 0 ].all = j->boot_segments;
+
   /* Setup */
   j->finished = 0;
   j->processed_until = 1;
-  j->finished_until = 1;
-  j->working_on = 0;
+  j->finished_until = 0;
+  j->working_on = 1;
   j->aim = s->chunk_count;
   j->last_saved = 0;
 }
@@ -139,6 +277,12 @@ void jobs_destroy( struct state * s )
     free( j->processed );
     j->processed = NULL;
   }
+
+  if ( j->base )
+  {
+    free( j->base );
+    j->base = NULL;
+  }
 }
 
 /**
@@ -152,6 +296,18 @@ void jobs_run( struct state * s, struct job * job )
   if ( !( j = s->job_mngr ) || !( c = s->chunk_mngr ) )
     return;
 
+  if ( job->filtered_chunk == 1 )
+  {
+    jobs_run_bootstrap( s, job->divider_chunk - 1 );
+    return;
+  }
+
+  if ( s->algorithm == JOBS_ATKIN )
+  {
+    jobs_run_atkin( s, job->filtered_chunk );
+    return;
+  }
+
   /* sleep( 1 ); */
   int divider_chunk = job->divider_chunk;
   int filtered_chunk = job->filtered_chunk;
@@ -159,57 +315,189 @@ void jobs_run( struct state * s, struct job * job )
   uint64_t first_filtered = (filtered_chunk - 1) * s->chunk_size * 8;
   uint64_t filter_until = (filtered_chunk) * s->chunk_size * 8;
   uint64_t act_filter;
+  int spf = s->spf_mngr && s->spf_mngr->data;
+
+  uint8_t * bits = c->sieve_data + ( first_filtered >> 3ull );
 
   int i;
   for (i = c->primes_index[divider_chunk];
        i < c->primes_index[divider_chunk+1]; i++ )
   {
     act_filter = chunks_get_prime( s, i );
-    uint64_t cancel_n = ((first_filtered * 2ull + 1ull) / act_filter) * act_filter;
-    if (cancel_n < first_filtered )
+    s->kernel->cross_out( bits, first_filtered,
+                          filter_until - first_filtered, act_filter );
+    if ( spf )
+      spf_cross_out( s, first_filtered, filter_until - first_filtered,
+                     act_filter );
+  }
+
+  if ( !s->quiet )
+    printf( "thread %lu filtered %d with %d\n", (unsigned long)pthread_self(), job->filtered_chunk, job->divider_chunk );
+
+}
+
+
+/**
+ * Crosses out the odd multiples of a prime in a segment of an odd-only
+ * bitmap with the baseline code, the jobs use the kernel of the host
+ * @param bits  Bitmap, bit i stands for 2 * ( first + i ) + 1
+ * @param first Index of the first odd number in the segment
+ * @param count Number of odd numbers in the segment
+ * @param prime Prime to cross out
+ */
+void jobs_cross_out( uint8_t * bits, uint64_t first, uint64_t count,
+                     uint64_t prime )
+{
+  kernel_cross_out_body( bits, first, count, prime );
+}
+
+/**
+ * Sieve of Atkin on a segment of an odd-only bitmap. Every bit is set,
+ * then the bits of the odd numbers with an odd number of representations
+ * by the quadratic forms are cleared. Squares of primes must be crossed
+ * out afterwards with jobs_cross_out_square. The segment must start and
+ * end on a byte boundary
+ * @param bits  Bitmap, bit i stands for 2 * ( first + i ) + 1
+ * @param first Index of the first odd number in the segment
+ * @param count Number of odd numbers in the segment
+ */
+void jobs_atkin( uint8_t * bits, uint64_t first, uint64_t count )
+{
+  uint64_t low, high, x, y, n, r, i, base;
+
+  memset( bits, 0xFF, count >> 3ull );
+
+  low = ( first << 1ull ) + 1ull;
+  high = ( ( first + count ) << 1ull ) + 1ull;
+
+  /* 4x^2 + y^2 = n, n mod 12 in { 1, 5 }, y is odd */
+  for ( x = 1; ( base = 4 * x * x ) < high; ++x )
+  {
+    y = 1;
+    if ( base < low )
     {
-      cancel_n += act_filter;
+      r = jobs_isqrt( low - base - 1 );
+      y = ( r + 1 ) | 1;
     }
-    while (cancel_n < filter_until * 2ull + 1ull)
+
+    for ( ; ( n = base + y * y ) < high; y += 2 )
     {
-      cross_out(s, cancel_n);
-      cancel_n += act_filter;
+      if ( ( r = n % 12 ) == 1 || r == 5 )
+      {
+        i = ( n >> 1ull ) - first;
+        bits[ i >> 3ull ] ^= 1 << ( i & 7ull );
+      }
     }
   }
 
+  /* 3x^2 + y^2 = n, n mod 12 = 7, x is odd and y is even */
+  for ( x = 1; ( base = 3 * x * x ) < high; x += 2 )
+  {
+    y = 2;
+    if ( base < low )
+    {
+      r = jobs_isqrt( low - base - 1 );
+      y = ( r + 2 ) & ~1ull;
+    }
 
+    for ( ; ( n = base + y * y ) < high; y += 2 )
+    {
+      if ( n % 12 == 7 )
+      {
+        i = ( n >> 1ull ) - first;
+        bits[ i >> 3ull ] ^= 1 << ( i & 7ull );
+      }
+    }
+  }
 
-  printf( "thread %u filtered %d with %d\n", pthread_self(), job->filtered_chunk, job->divider_chunk );
+  /* 3x^2 - y^2 = n with x > y, n mod 12 = 11, x and y differ in parity,
+   * n falls from 3x^2 - 1 to 2x^2 + 2x - 1 as y grows to x - 1
+   */
+  for ( x = 2; 2 * x * x + 2 * x - 1 < high; ++x )
+  {
+    base = 3 * x * x;
+
+    /* Largest y keeping n >= low */
+    if ( base <= low )
+      continue;
+    r = jobs_isqrt( base - low );
+    y = r < x - 1 ? r : x - 1;
+    if ( !( ( x ^ y ) & 1 ) )
+    {
+      if ( y-- == 0 )
+        continue;
+    }
 
+    for ( ; y >= 1 && ( n = base - y * y ) < high; y -= 2 )
+    {
+      if ( n % 12 == 11 )
+      {
+        i = ( n >> 1ull ) - first;
+        bits[ i >> 3ull ] ^= 1 << ( i & 7ull );
+      }
+      if ( y < 2 )
+        break;
+    }
+  }
 }
 
-
-inline void cross_out (struct state * s, uint64_t n) 
+/**
+ * Crosses out the odd multiples of the square of a prime in a segment
+ * of an odd-only bitmap, finishing the Sieve of Atkin
+ * @param bits  Bitmap, bit i stands for 2 * ( first + i ) + 1
+ * @param first Index of the first odd number in the segment
+ * @param count Number of odd numbers in the segment
+ * @param prime Prime whose square is crossed out
+ */
+void jobs_cross_out_square( uint8_t * bits, uint64_t first, uint64_t count,
+                            uint64_t prime )
 {
+  uint64_t low, sq, n, i;
 
-  if ( n & 1ull == 1)
+  /* Multiples of 3 are never generated */
+  if ( prime < 5ull || prime > UINT32_MAX )
+    return;
+
+  sq = prime * prime;
+  low = ( first << 1ull ) + 1ull;
+  n = low + ( sq - low % sq ) % sq;
+  if ( !( n & 1ull ) )
+    n += sq;
+
+  for ( i = ( n >> 1ull ) - first; i < count; i += sq )
   {
-    n = n >> 1;
-    uint64_t byte_number = n >> 3ull;
-    uint64_t mod = n & 7ull;
-    s->chunk_mngr->sieve_data[byte_number] = s->chunk_mngr->sieve_data[byte_number] | (1ull << mod);
+    bits[ i >> 3ull ] |= 1 << ( i & 7ull );
   }
 }
 
 void jobs_save_finished (struct state * s, int n)
 {
-  printf("saved %d: \n",n);
+  if ( !s->quiet )
+    printf("saved %d: \n",n);
+  if ( n == 1 )
+  {
+    /* 1 is not a prime and 2 is not in the sieve */
+    s->chunk_mngr->sieve_data[0] |= 1;
+    chunks_write_prime( s, 2 );
+  }
+
   n--;
-  uint64_t i;
-  for (i = n * s->chunk_size * 8; i < (n+1) * s->chunk_size * 8; i++)
+  uint64_t i, end, count, primes[ KERNEL_BATCH + KERNEL_SLACK ];
+  end = (n+1) * s->chunk_size * 8;
+  for (i = n * s->chunk_size * 8; i < end; i += KERNEL_BATCH)
   {
-    if ( ( s->chunk_mngr->sieve_data[i >> 3ull] & (1 << (i & 7) ) ) == 0)
-    {
-      chunks_write_prime( s, 2*i+1 );
-    }
+    count = s->kernel->extract( s->chunk_mngr->sieve_data + ( i >> 3ull ), i,
+                                end - i < KERNEL_BATCH ? end - i : KERNEL_BATCH,
+                                primes );
+    chunks_write_primes( s, primes, count );
   }
 
-  s->chunk_mngr->primes_index[n+1]=s->chunk_mngr->primes_count;
+  s->chunk_mngr->primes_index[n+2]=s->chunk_mngr->primes_count;
+
+  /* Chunks are saved in order */
+  s->chunk_mngr->sieve_header->chunks_saved = n + 1;
+  rank_chunk( s, n + 1 );
+  metrics_saved( s, n + 1, s->chunk_mngr->primes_count );
   /*for (int i = 0; i < s->chunk_mngr->primes_count; i++) 
   {
     printf("%u ", chunks_get_prime(s,i));
@@ -244,11 +532,19 @@ int jobs_next( struct state * s, struct job * job )
   int next_index;
   next.filtered_chunk = INT_MAX;
 
-  /* Looking for the smallest chunk we can work on */
+  /* Looking for the smallest chunk we can work on. A chunk is owned
+   * by the thread running its job, so a column is only available once
+   * every job handed out from it is done, otherwise two threads would
+   * modify the same bytes of the sieve. The segments of chunk 1 do not
+   * overlap, they can run at the same time. At most one job per open
+   * column runs, so with fewer open columns than threads some idle
+   */
   int k = 0;
-  while ( j->processed[k].n != -1 )
+  while ( k < j->columns && j->processed[k].n != -1 )
   {
-    if (j->processed[k].working < j->finished_until
+    if ((j->processed[k].n == 1 ||
+         (j->processed[k].working < j->finished_until &&
+          j->processed[k].working == j->processed[k].done))
         && j->processed[k].working < j->processed[k].all
         && j->processed[k].n < next.filtered_chunk )
     {
@@ -261,14 +557,20 @@ int jobs_next( struct state * s, struct job * job )
   /* If there is no available job with current chunks */
   if ( next.filtered_chunk == INT_MAX )
   {
-    /* If we can work on a new chunk */
-    if ( j->processed_until < j->aim )
+    /* If we can work on a new chunk, which needs chunk 1 */
+    if ( j->processed_until < j->aim && k < j->columns &&
+         j->finished_until >= 1 )
     {
       j->working_on++;
       ++j->processed_until;
-      j->processed[k].n = j->processed_until;
-      j->processed[k].all = j->processed[k].n-1;
-      j->processed[k].working = j->processed[k].done = 0;
+      jobs_column( s, &j->processed[k], j->processed_until );
+      metrics_queue( s, j->finished_until,
+                     j->processed_until - j->finished_until );
+
+      /* With Atkin, the divider of the new chunk might not be saved */
+      if ( j->processed[k].working >= j->finished_until )
+        return 0;
+
       next.filtered_chunk = j->processed[k].n;
       next_index = k;
     }
@@ -286,8 +588,9 @@ int jobs_next( struct state * s, struct job * job )
 
 /**
  * Marks a job as finished so other threads can fetch jobs
- * which depend on this one, calls threads_finish when there
- * are no more available jobs
+ * which depend on this one, wakes up the parked threads when
+ * a saved chunk makes new jobs available and calls threads_finish
+ * when there are no more available jobs
  * @param s
  * @param job
  */
@@ -315,6 +618,12 @@ void jobs_finish( struct state * s, struct job * job, int * save )
     {
       j->finished_until++;
     }
+    metrics_queue( s, j->finished_until, j->processed_until - j->finished_until );
+
+    /* Jobs depending on the chunk and the chunk loaded in its place
+     * are available once the queue lock is released
+     */
+    threads_wake( s );
 
     /* If this is the last chunk needed */
     if ( j->aim == j->finished_until )
@@ -334,13 +643,23 @@ void jobs_finish( struct state * s, struct job * job, int * save )
       {
         j->working_on++;
         ++j->processed_until;
-        j->processed[save_k].n = j->processed_until;
-        j->processed[save_k].all = j->processed_until-1;
-        j->processed[save_k].working = j->processed[save_k].done = 0;
+        jobs_column( s, &j->processed[save_k], j->processed_until );
       }
     }
 
-    *save = 0;
+    /* The next chunk might have been finished while waiting for this
+     * one, in which case it is saved right away by the same thread
+     */
+    for ( save_k = 0; save_k < j->columns; ++save_k )
+    {
+      if ( j->processed[save_k].n == j->finished_until + 1 &&
+           j->processed[save_k].done == j->processed[save_k].all )
+      {
+        job->filtered_chunk = j->processed[save_k].n;
+        *save = 1;
+        break;
+      }
+    }
     return;
   }
 
@@ -355,7 +674,11 @@ void jobs_finish( struct state * s, struct job * job, int * save )
   }
 
   /* Updating, loading new if finished */
-  if ( ++j->processed[k].done == j->processed[k].all )
+  /* Chunks are saved in order, with Atkin a chunk can finish before
+   * the one in front of it, then it is saved after that one
+   */
+  if ( ++j->processed[k].done == j->processed[k].all &&
+       j->finished_until + 1 == j->processed[k].n )
   {
     /* Finished filtering a chunk
      * Save_finished_chunk(j->processed[k].n);
@@ -25,6 +25,8 @@ THE SOFTWARE.
 #ifndef JOB_H
 #define JOB_H
 
+#include <stdint.h>
+
 struct state;
 struct column;
 
@@ -35,9 +37,25 @@ struct job
 };
 
 
+/* Number of chunks which can be processed at once, unless the
+ * memory budget asks for fewer
+ */
+#define JOBS_COLUMNS 100
+
+/* Size of the segments chunk 1 is split into, in bytes */
+#define JOBS_BOOT_SEGMENT ( 32 << 10 )
+
+/* Sieving algorithms */
+#define JOBS_ERATOSTHENES 0
+#define JOBS_ATKIN        1
+
 struct jobs
 {
   struct column * processed;
+  int columns;
+  uint64_t * base;
+  uint64_t base_count;
+  int boot_segments;
   uint8_t * chunk_saved;
   int processed_until;
   int finished_until;
@@ -53,5 +71,9 @@ void jobs_run( struct state *, struct job * );
 int  jobs_next( struct state *, struct job * );
 void jobs_finish( struct state *, struct job *, int * save );
 void jobs_save_finished (struct state * s, int n);
+void jobs_cross_out( uint8_t *, uint64_t first, uint64_t count, uint64_t );
+void jobs_atkin( uint8_t *, uint64_t first, uint64_t count );
+void jobs_cross_out_square( uint8_t *, uint64_t first, uint64_t count,
+                            uint64_t );
 
 #endif
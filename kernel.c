@@ -0,0 +1,380 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <immintrin.h>
+#include "kernel.h"
+#include "state.h"
+
+/**
+ * Extracts the primes of a bitmap a word at a time
+ * @param bits
+ * @param first
+ * @param count
+ * @param out
+ */
+static inline __attribute__(( always_inline ))
+uint64_t kernel_extract_body( const uint8_t * bits, uint64_t first,
+                              uint64_t count, uint64_t * out )
+{
+  uint64_t w, word, base, n;
+
+  for ( n = 0, w = 0; w < ( count >> 6ull ); ++w )
+  {
+    memcpy( &word, bits + ( w << 3ull ), sizeof( word ) );
+    word = ~word;
+    base = ( ( first + ( w << 6ull ) ) << 1ull ) + 1ull;
+
+    /* Lowest set bit first, the primes come out in order */
+    while ( word )
+    {
+      out[ n++ ] = base + ( (uint64_t)__builtin_ctzll( word ) << 1ull );
+      word &= word - 1;
+    }
+  }
+
+  return n;
+}
+
+/**
+ * Counts the set bits of a buffer a word at a time
+ * @param bits
+ * @param bytes
+ */
+static inline __attribute__(( always_inline ))
+uint64_t kernel_popcount_body( const uint8_t * bits, uint64_t bytes )
+{
+  uint64_t i, word, count;
+
+  for ( count = 0, i = 0; i + 8 <= bytes; i += 8 )
+  {
+    memcpy( &word, bits + i, sizeof( word ) );
+    count += __builtin_popcountll( word );
+  }
+
+  for ( ; i < bytes; ++i )
+    count += __builtin_popcount( bits[ i ] );
+
+  return count;
+}
+
+/**
+ * Compares 64 bytes to a threshold one at a time
+ * @param bytes
+ * @param min
+ */
+static inline __attribute__(( always_inline ))
+uint64_t kernel_threshold_body( const uint8_t * bytes, uint8_t min )
+{
+  uint64_t mask;
+  int i;
+
+  for ( mask = 0, i = 0; i < 64; ++i )
+    mask |= (uint64_t)( bytes[ i ] >= min ) << i;
+
+  return mask;
+}
+
+/* Portable variant, built for the baseline of the binary */
+static int kernel_generic_supported( void )
+{
+  return 1;
+}
+
+static void kernel_generic_cross_out( uint8_t * bits, uint64_t first,
+                                      uint64_t count, uint64_t prime )
+{
+  kernel_cross_out_body( bits, first, count, prime );
+}
+
+static uint64_t kernel_generic_extract( const uint8_t * bits, uint64_t first,
+                                        uint64_t count, uint64_t * out )
+{
+  return kernel_extract_body( bits, first, count, out );
+}
+
+static uint64_t kernel_generic_popcount( const uint8_t * bits, uint64_t bytes )
+{
+  return kernel_popcount_body( bits, bytes );
+}
+
+static uint64_t kernel_generic_threshold( const uint8_t * bytes, uint8_t min )
+{
+  return kernel_threshold_body( bytes, min );
+}
+
+/* SSE4.2 hosts have popcnt, which the baseline cannot assume */
+static int kernel_sse42_supported( void )
+{
+  return __builtin_cpu_supports( "sse4.2" ) &&
+         __builtin_cpu_supports( "popcnt" );
+}
+
+__attribute__(( target( "sse4.2,popcnt" ) ))
+static void kernel_sse42_cross_out( uint8_t * bits, uint64_t first,
+                                    uint64_t count, uint64_t prime )
+{
+  kernel_cross_out_body( bits, first, count, prime );
+}
+
+__attribute__(( target( "sse4.2,popcnt" ) ))
+static uint64_t kernel_sse42_extract( const uint8_t * bits, uint64_t first,
+                                      uint64_t count, uint64_t * out )
+{
+  return kernel_extract_body( bits, first, count, out );
+}
+
+__attribute__(( target( "sse4.2,popcnt" ) ))
+static uint64_t kernel_sse42_popcount( const uint8_t * bits, uint64_t bytes )
+{
+  return kernel_popcount_body( bits, bytes );
+}
+
+/**
+ * Unsigned bytes have no compare, a byte is at least min
+ * exactly where max( byte, min ) equals the byte
+ */
+__attribute__(( target( "sse4.2,popcnt" ) ))
+static uint64_t kernel_sse42_threshold( const uint8_t * bytes, uint8_t min )
+{
+  __m128i m, v;
+  uint64_t mask;
+  int i;
+
+  m = _mm_set1_epi8( (char)min );
+  for ( mask = 0, i = 0; i < 64; i += 16 )
+  {
+    v = _mm_loadu_si128( (const __m128i*)( bytes + i ) );
+    mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8( _mm_max_epu8( v, m ), v ) ) << i;
+  }
+
+  return mask;
+}
+
+/* AVX2 hosts also have BMI, tzcnt and blsr speed up the extraction */
+static int kernel_avx2_supported( void )
+{
+  return __builtin_cpu_supports( "avx2" ) &&
+         __builtin_cpu_supports( "bmi" ) &&
+         __builtin_cpu_supports( "popcnt" );
+}
+
+__attribute__(( target( "avx2,bmi,bmi2,popcnt" ) ))
+static void kernel_avx2_cross_out( uint8_t * bits, uint64_t first,
+                                   uint64_t count, uint64_t prime )
+{
+  kernel_cross_out_body( bits, first, count, prime );
+}
+
+__attribute__(( target( "avx2,bmi,bmi2,popcnt" ) ))
+static uint64_t kernel_avx2_extract( const uint8_t * bits, uint64_t first,
+                                     uint64_t count, uint64_t * out )
+{
+  return kernel_extract_body( bits, first, count, out );
+}
+
+/**
+ * Counts bits 32 bytes at a time, looking up the count of each nibble
+ * with a shuffle and summing the bytes with sad
+ */
+__attribute__(( target( "avx2,bmi,bmi2,popcnt" ) ))
+static uint64_t kernel_avx2_popcount( const uint8_t * bits, uint64_t bytes )
+{
+  __m256i table, low, sum, v, lo, hi;
+  uint64_t i, lanes[ 4 ];
+
+  table = _mm256_setr_epi8( 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 );
+  low = _mm256_set1_epi8( 0x0F );
+  sum = _mm256_setzero_si256( );
+
+  for ( i = 0; i + 32 <= bytes; i += 32 )
+  {
+    v = _mm256_loadu_si256( (const __m256i*)( bits + i ) );
+    lo = _mm256_shuffle_epi8( table, _mm256_and_si256( v, low ) );
+    hi = _mm256_shuffle_epi8( table,
+                              _mm256_and_si256( _mm256_srli_epi16( v, 4 ), low ) );
+    sum = _mm256_add_epi64( sum, _mm256_sad_epu8( _mm256_add_epi8( lo, hi ),
+                                                  _mm256_setzero_si256( ) ) );
+  }
+
+  _mm256_storeu_si256( (__m256i*)lanes, sum );
+  return lanes[ 0 ] + lanes[ 1 ] + lanes[ 2 ] + lanes[ 3 ] +
+         kernel_popcount_body( bits + i, bytes - i );
+}
+
+/**
+ * Compares 32 bytes at a time with the max trick of the SSE variant
+ */
+__attribute__(( target( "avx2,bmi,bmi2,popcnt" ) ))
+static uint64_t kernel_avx2_threshold( const uint8_t * bytes, uint8_t min )
+{
+  __m256i m, lo, hi;
+
+  m = _mm256_set1_epi8( (char)min );
+  lo = _mm256_loadu_si256( (const __m256i*)bytes );
+  hi = _mm256_loadu_si256( (const __m256i*)( bytes + 32 ) );
+  lo = _mm256_cmpeq_epi8( _mm256_max_epu8( lo, m ), lo );
+  hi = _mm256_cmpeq_epi8( _mm256_max_epu8( hi, m ), hi );
+
+  return (uint64_t)(uint32_t)_mm256_movemask_epi8( lo ) |
+         (uint64_t)(uint32_t)_mm256_movemask_epi8( hi ) << 32;
+}
+
+/* AVX-512 hosts compress the numbers of the cleared bits into place */
+static int kernel_avx512_supported( void )
+{
+  return __builtin_cpu_supports( "avx512f" ) &&
+         __builtin_cpu_supports( "avx512bw" ) &&
+         __builtin_cpu_supports( "popcnt" );
+}
+
+__attribute__(( target( "avx512f,avx512bw,bmi,bmi2,popcnt" ) ))
+static void kernel_avx512_cross_out( uint8_t * bits, uint64_t first,
+                                     uint64_t count, uint64_t prime )
+{
+  kernel_cross_out_body( bits, first, count, prime );
+}
+
+/**
+ * Each byte of the bitmap masks eight numbers, the selected ones
+ * are compressed to the front of a vector and stored. The store is
+ * always eight entries wide, hence the slack at the end of out
+ */
+__attribute__(( target( "avx512f,avx512bw,bmi,bmi2,popcnt" ) ))
+static uint64_t kernel_avx512_extract( const uint8_t * bits, uint64_t first,
+                                       uint64_t count, uint64_t * out )
+{
+  __m512i numbers, step;
+  __mmask8 mask;
+  uint64_t i, n;
+
+  numbers = _mm512_add_epi64( _mm512_set_epi64( 15, 13, 11, 9, 7, 5, 3, 1 ),
+                              _mm512_set1_epi64( (long long)( first << 1ull ) ) );
+  step = _mm512_set1_epi64( 16 );
+
+  for ( n = 0, i = 0; i < ( count >> 3ull ); ++i )
+  {
+    mask = (__mmask8)~bits[ i ];
+    _mm512_storeu_si512( (void*)( out + n ),
+                         _mm512_maskz_compress_epi64( mask, numbers ) );
+    n += __builtin_popcount( mask );
+    numbers = _mm512_add_epi64( numbers, step );
+  }
+
+  return n;
+}
+
+/**
+ * Counts bits 64 bytes at a time with the nibble table
+ */
+__attribute__(( target( "avx512f,avx512bw,bmi,bmi2,popcnt" ) ))
+static uint64_t kernel_avx512_popcount( const uint8_t * bits, uint64_t bytes )
+{
+  __m512i table, low, sum, v, lo, hi;
+  uint64_t i;
+
+  table = _mm512_set_epi32( 0x04030302, 0x03020201, 0x03020201, 0x02010100,
+                            0x04030302, 0x03020201, 0x03020201, 0x02010100,
+                            0x04030302, 0x03020201, 0x03020201, 0x02010100,
+                            0x04030302, 0x03020201, 0x03020201, 0x02010100 );
+  low = _mm512_set1_epi8( 0x0F );
+  sum = _mm512_setzero_si512( );
+
+  for ( i = 0; i + 64 <= bytes; i += 64 )
+  {
+    v = _mm512_loadu_si512( (const void*)( bits + i ) );
+    lo = _mm512_shuffle_epi8( table, _mm512_and_si512( v, low ) );
+    hi = _mm512_shuffle_epi8( table,
+                              _mm512_and_si512( _mm512_srli_epi16( v, 4 ), low ) );
+    sum = _mm512_add_epi64( sum, _mm512_sad_epu8( _mm512_add_epi8( lo, hi ),
+                                                  _mm512_setzero_si512( ) ) );
+  }
+
+  return (uint64_t)_mm512_reduce_add_epi64( sum ) +
+         kernel_popcount_body( bits + i, bytes - i );
+}
+
+/**
+ * Compares 64 bytes at once into a mask register
+ */
+__attribute__(( target( "avx512f,avx512bw,bmi,bmi2,popcnt" ) ))
+static uint64_t kernel_avx512_threshold( const uint8_t * bytes, uint8_t min )
+{
+  return _mm512_cmpge_epu8_mask( _mm512_loadu_si512( (const void*)bytes ),
+                                 _mm512_set1_epi8( (char)min ) );
+}
+
+/* Variants from the most to the least capable */
+static const struct kernel kernels[ ] =
+{
+  { "avx512",  kernel_avx512_supported,  kernel_avx512_cross_out,
+    kernel_avx512_extract,  kernel_avx512_popcount,
+    kernel_avx512_threshold },
+  { "avx2",    kernel_avx2_supported,    kernel_avx2_cross_out,
+    kernel_avx2_extract,    kernel_avx2_popcount,
+    kernel_avx2_threshold },
+  { "sse42",   kernel_sse42_supported,   kernel_sse42_cross_out,
+    kernel_sse42_extract,   kernel_sse42_popcount,
+    kernel_sse42_threshold },
+  { "generic", kernel_generic_supported, kernel_generic_cross_out,
+    kernel_generic_extract, kernel_generic_popcount,
+    kernel_generic_threshold }
+};
+
+/**
+ * Picks the best variant the host supports, or the one named
+ * by --kernel if it can run here
+ * @param s
+ */
+void kernel_select( struct state * s )
+{
+  size_t i, count;
+
+  __builtin_cpu_init( );
+  count = sizeof( kernels ) / sizeof( kernels[ 0 ] );
+
+  for ( i = 0; i < count; ++i )
+  {
+    if ( s->kernel_name && strcmp( s->kernel_name, kernels[ i ].name ) )
+      continue;
+
+    if ( !kernels[ i ].supported( ) )
+    {
+      if ( s->kernel_name )
+        state_error( s, "Kernel %s is not supported by this CPU",
+                     s->kernel_name );
+      continue;
+    }
+
+    s->kernel = &kernels[ i ];
+    if ( !s->quiet )
+      printf( "using the %s kernels\n", s->kernel->name );
+    return;
+  }
+
+  state_error( s, "Unknown kernel: %s", s->kernel_name );
+}
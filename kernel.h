@@ -0,0 +1,100 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stdint.h>
+
+/* Number of bits extracted at once, a multiple of 64 */
+#define KERNEL_BATCH 4096
+
+/* Extra entries written past the primes by the vector kernels */
+#define KERNEL_SLACK 8
+
+struct state;
+
+struct kernel
+{
+  /* Name used by --kernel */
+  const char * name;
+
+  /* Returns non-zero if the host can run the variant */
+  int ( * supported )( void );
+
+  /* Crosses out the odd multiples of a prime, see jobs_cross_out */
+  void ( * cross_out )( uint8_t * bits, uint64_t first, uint64_t count,
+                        uint64_t prime );
+
+  /* Writes the numbers of the cleared bits to out and returns their
+   * count, first and count must be multiples of 64 and out must have
+   * room for KERNEL_SLACK more entries
+   */
+  uint64_t ( * extract )( const uint8_t * bits, uint64_t first,
+                          uint64_t count, uint64_t * out );
+
+  /* Counts the set bits of a buffer */
+  uint64_t ( * popcount )( const uint8_t * bits, uint64_t bytes );
+
+  /* Returns a mask of the bytes among 64 which are at least min */
+  uint64_t ( * threshold )( const uint8_t * bytes, uint8_t min );
+};
+
+/**
+ * Crosses out the odd multiples of a prime in a segment of an odd-only
+ * bitmap, starting from the square of the prime so the primes stored
+ * in the segment are left alone. Shared by every kernel variant
+ * @param bits  Bitmap, bit i stands for 2 * ( first + i ) + 1
+ * @param first Index of the first odd number in the segment
+ * @param count Number of odd numbers in the segment
+ * @param prime Prime to cross out
+ */
+static inline __attribute__(( always_inline ))
+void kernel_cross_out_body( uint8_t * bits, uint64_t first, uint64_t count,
+                            uint64_t prime )
+{
+  uint64_t low, n, i;
+
+  /* Only odd primes with a square below 2^64 have work to do */
+  if ( prime < 3ull || prime > UINT32_MAX )
+    return;
+
+  low = ( first << 1ull ) + 1ull;
+  if ( ( n = prime * prime ) < low )
+  {
+    n = low + ( prime - low % prime ) % prime;
+    if ( !( n & 1ull ) )
+      n += prime;
+  }
+
+  /* Odd multiples are one prime apart in the bitmap */
+  for ( i = ( n >> 1ull ) - first; i < count; i += prime )
+  {
+    bits[ i >> 3ull ] |= 1 << ( i & 7ull );
+  }
+}
+
+void kernel_select( struct state * );
+
+#endif
@@ -0,0 +1,698 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include "state.h"
+#include "chunk.h"
+#include "iterator.h"
+#include "job.h"
+#include "thread.h"
+#include "lmo.h"
+
+/* Segment of odd numbers processed by a block */
+struct lmo_block
+{
+  /* Tables shared by the blocks */
+  struct lmo * lmo;
+
+  /* Odd numbers 2 * first + 1 to 2 * last - 1 are covered */
+  uint64_t first;
+  uint64_t last;
+
+  /* Levels of the partial sieve function used by the block */
+  uint64_t levels;
+
+  /* Special leaves, counted from the start of the block */
+  lmo_int sum;
+
+  /* Numbers left in the block after removing the first b primes */
+  int64_t * phi;
+
+  /* Sum of the signs of the leaves at each level, multiplies the
+   * count left in the preceding blocks
+   */
+  int64_t * weights;
+
+  /* Sum of pi( x / p ) for the primes y < p <= sqrt( x ) whose quotient
+   * falls into the block, counted from the start of the block
+   */
+  lmo_uint p2_sum;
+
+  /* Number of primes contributing to p2_sum */
+  uint64_t p2_count;
+
+  /* Number of odd primes in the block */
+  uint64_t p2_primes;
+};
+
+/**
+ * Divides x, falling back to 128 bit division only if required
+ * @param x
+ * @param d
+ */
+static inline uint64_t lmo_div( lmo_uint x, lmo_uint d )
+{
+  if ( d > x )
+    return 0;
+
+  if ( !( x >> 64 ) )
+    return (uint64_t)x / (uint64_t)d;
+
+  return (uint64_t)( x / d );
+}
+
+/**
+ * Integer square root
+ * @param x
+ */
+uint64_t lmo_isqrt( lmo_uint x )
+{
+  uint64_t r;
+
+  r = (uint64_t)sqrtl( (long double)x );
+  while ( r && (lmo_uint)r * r > x )
+    r--;
+  while ( (lmo_uint)( r + 1 ) * ( r + 1 ) <= x )
+    r++;
+
+  return r;
+}
+
+/**
+ * Integer cube root
+ * @param x
+ */
+static uint64_t lmo_icbrt( lmo_uint x )
+{
+  uint64_t r;
+
+  r = (uint64_t)cbrtl( (long double)x );
+  while ( r && (lmo_uint)r * r * r > x )
+    r--;
+  while ( (lmo_uint)( r + 1 ) * ( r + 1 ) * ( r + 1 ) <= x )
+    r++;
+
+  return r;
+}
+
+/**
+ * Parses a decimal number. 1e18 and 2^64 style exponents are
+ * accepted, as are sums of such terms like 2^64+1000
+ * @param str
+ * @param out Value of the number
+ * @return 0 if invalid
+ */
+int lmo_parse( const char * str, lmo_uint * out )
+{
+  lmo_uint x, b, sum;
+  int e;
+
+  for ( sum = 0; ; ++str )
+  {
+    if ( *str < '0' || *str > '9' )
+      return 0;
+
+    for ( x = 0; *str >= '0' && *str <= '9'; ++str )
+      x = x * 10 + ( *str - '0' );
+
+    if ( *str == 'e' || *str == 'E' || *str == '^' )
+    {
+      /* 1e18 scales the mantissa, 2^64 raises the base */
+      b = 10;
+      if ( *str == '^' )
+        b = x, x = 1;
+
+      for ( e = atoi( ++str ); e > 0 && x; --e )
+        x *= b;
+      while ( *str >= '0' && *str <= '9' )
+        ++str;
+    }
+
+    sum += x;
+    if ( *str != '+' )
+      break;
+  }
+
+  *out = sum;
+  return !*str;
+}
+
+/**
+ * Prints a 128 bit number in decimal
+ * @param f
+ * @param x
+ */
+void lmo_print( FILE * f, lmo_uint x )
+{
+  char buf[ 48 ], * p;
+
+  p = buf + sizeof( buf ) - 1;
+  *p = '\0';
+  do
+  {
+    *--p = '0' + (int)( x % 10 );
+    x /= 10;
+  } while ( x );
+
+  fputs( p, f );
+}
+
+/**
+ * Computes the tables used to count the leaves of x
+ * @param s
+ * @param x
+ */
+void lmo_create( struct state * s, lmo_uint x )
+{
+  struct primes_iterator it;
+  struct lmo * l;
+  uint64_t i, j, n, p, y;
+  double alpha;
+
+  if ( !( l = s->lmo_mngr ) )
+    return;
+
+  /* y = alpha * x^(1/3) trades the leaves for the length of the sieve,
+   * y must stay below sqrt( x ) and in the range of the tables
+   */
+  alpha = log( (double)x ) / 10.0;
+  alpha = alpha * alpha / 2.0;
+  alpha = alpha > 10.0 ? 10.0 : alpha;
+  y = lmo_icbrt( x ) + 1;
+  y = alpha > 1.0 ? (uint64_t)( y * alpha ) : y;
+  if ( y > lmo_isqrt( x ) )
+    y = lmo_isqrt( x );
+  if ( y < 2 )
+    y = 2;
+  if ( y >= UINT32_MAX )
+    state_error( s, "Too large to count" );
+
+  l->x = x;
+  l->y = y;
+  l->z = lmo_div( x, y );
+
+  /* Primes up to y */
+  assert( l->pi = (uint32_t*)malloc( sizeof( uint32_t ) * ( y + 1 ) ) );
+  memset( l->pi, 0, sizeof( uint32_t ) * ( y + 1 ) );
+  assert( l->primes = (uint32_t*)malloc( sizeof( uint32_t ) * ( y / 2 + 2 ) ) );
+
+  if ( !primes_iterator_init( &it, 0 ) )
+    state_error( s, "Cannot create iterator" );
+
+  for ( l->a = 0; ( p = primes_iterator_next( &it ) ) && p <= y; )
+    l->primes[ l->a++ ] = (uint32_t)p;
+
+  primes_iterator_destroy( &it );
+
+  for ( i = 1, j = 0; i <= y; ++i )
+  {
+    if ( j < l->a && l->primes[ j ] == i )
+      j++;
+    l->pi[ i ] = (uint32_t)j;
+  }
+
+  /* Moebius function and least prime factor */
+  assert( l->mu = (int8_t*)malloc( sizeof( int8_t ) * ( y + 1 ) ) );
+  assert( l->lpf = (uint32_t*)malloc( sizeof( uint32_t ) * ( y + 1 ) ) );
+  memset( l->mu, 1, sizeof( int8_t ) * ( y + 1 ) );
+  memset( l->lpf, 0, sizeof( uint32_t ) * ( y + 1 ) );
+  l->lpf[ 1 ] = UINT32_MAX;
+
+  for ( i = l->a; i-- > 0; )
+  {
+    p = l->primes[ i ];
+    for ( n = p; n <= y; n += p )
+    {
+      l->lpf[ n ] = (uint32_t)p;
+      l->mu[ n ] = -l->mu[ n ];
+    }
+    for ( n = p * p; n <= y; n += p * p )
+      l->mu[ n ] = 0;
+  }
+}
+
+/**
+ * Frees the tables
+ * @param s
+ */
+void lmo_destroy( struct state * s )
+{
+  struct lmo * l;
+
+  if ( !( l = s->lmo_mngr ) )
+    return;
+
+  if ( l->primes )
+  {
+    free( l->primes );
+    l->primes = NULL;
+  }
+
+  if ( l->pi )
+  {
+    free( l->pi );
+    l->pi = NULL;
+  }
+
+  if ( l->mu )
+  {
+    free( l->mu );
+    l->mu = NULL;
+  }
+
+  if ( l->lpf )
+  {
+    free( l->lpf );
+    l->lpf = NULL;
+  }
+}
+
+/**
+ * Counts the numbers left in the first n words of the bitmap
+ * @param tree Fenwick tree over the number of bits cleared in each word
+ * @param n
+ */
+static inline int64_t lmo_tree_sum( const int32_t * tree, int64_t n )
+{
+  int64_t sum;
+
+  for ( sum = 0, n--; n >= 0; n = ( n & ( n + 1 ) ) - 1 )
+    sum += tree[ n ];
+
+  return sum;
+}
+
+/**
+ * Counts the numbers left in the first n bits of the bitmap
+ * @param bits
+ * @param tree
+ * @param n
+ */
+static inline int64_t lmo_alive( const uint64_t * bits, const int32_t * tree,
+                                 uint64_t n )
+{
+  int64_t sum;
+
+  sum = lmo_tree_sum( tree, n >> 6 );
+  if ( n & 63 )
+    sum += __builtin_popcountll( ~bits[ n >> 6 ] & ( ( 1ull << ( n & 63 ) ) - 1 ) );
+
+  return sum;
+}
+
+/**
+ * Finds the special leaves whose quotient falls into the block,
+ * sieving the block with the primes up to y in order
+ * @param bp Block pointer
+ */
+static void lmo_leaves( void * bp )
+{
+  struct lmo_block * blk = (struct lmo_block*)bp;
+  struct lmo * l = blk->lmo;
+  uint64_t * bits, f, len, lo, hi, b, bmax, p, m, lim, v, k, w, words, n;
+  int32_t * tree;
+  int64_t cnt, j;
+  lmo_int sum;
+
+  words = LMO_SEGMENT >> 6;
+  assert( bits = (uint64_t*)malloc( sizeof( uint64_t ) * words ) );
+  assert( tree = (int32_t*)malloc( sizeof( int32_t ) * words ) );
+
+  sum = 0;
+  for ( f = blk->first; f < blk->last; f += len )
+  {
+    len = blk->last - f < LMO_SEGMENT ? blk->last - f : LMO_SEGMENT;
+    lo = 2 * f;
+    hi = 2 * ( f + len );
+
+    /* Only primes below sqrt( x / lo ) have leaves from here on */
+    bmax = lo ? l->pi[ ( v = lmo_isqrt( l->x / lo ) ) < l->y ? v : l->y ]
+              : l->a;
+    if ( bmax > blk->levels )
+      bmax = blk->levels;
+
+    /* Every odd number is left after removing 2, the padding is not */
+    memset( bits, 0, sizeof( uint64_t ) * words );
+    for ( k = len; k < words * 64; ++k )
+      bits[ k >> 6 ] |= 1ull << ( k & 63 );
+
+    for ( w = 0; w < words; ++w )
+      tree[ w ] = 64 - __builtin_popcountll( bits[ w ] );
+    for ( w = 0; w < words; ++w )
+      if ( ( w | ( w + 1 ) ) < words )
+        tree[ w | ( w + 1 ) ] += tree[ w ];
+
+    cnt = (int64_t)len;
+    for ( b = 1; b < bmax; ++b )
+    {
+      p = l->primes[ b ];
+
+      /* Leaves p * m with lo <= x / ( p * m ) < hi and m <= y < p * m */
+      m = lo ? lmo_div( l->x, (lmo_uint)p * lo ) : l->y;
+      m = m < l->y ? m : l->y;
+      lim = lmo_div( l->x, (lmo_uint)p * hi );
+      lim = lim > l->y / p ? lim : l->y / p;
+
+      if ( p * p <= l->y )
+      {
+        for ( ; m > lim; --m )
+        {
+          if ( !l->mu[ m ] || l->lpf[ m ] <= p )
+            continue;
+
+          v = lmo_div( l->x, (lmo_uint)p * m );
+          n = blk->phi[ b ] + lmo_alive( bits, tree, ( v + 1 ) / 2 - f );
+          sum -= l->mu[ m ] * (lmo_int)n;
+          blk->weights[ b ] -= l->mu[ m ];
+        }
+      }
+      else if ( m > lim )
+      {
+        /* Above sqrt( y ), m can only be a prime larger than p */
+        lim = lim > p ? lim : p;
+        for ( j = (int64_t)l->pi[ m ] - 1; j >= 0 && l->primes[ j ] > lim; --j )
+        {
+          v = lmo_div( l->x, (lmo_uint)p * l->primes[ j ] );
+          sum += blk->phi[ b ] + lmo_alive( bits, tree, ( v + 1 ) / 2 - f );
+          blk->weights[ b ]++;
+        }
+      }
+
+      blk->phi[ b ] += cnt;
+
+      /* Remove the odd multiples of p, including p */
+      n = lo > p ? lo : p;
+      n = ( n + p - 1 ) / p * p;
+      n += ( n & 1 ) ? 0 : p;
+      for ( k = ( n - 1 ) / 2 - f; k < len; k += p )
+      {
+        if ( bits[ k >> 6 ] & ( 1ull << ( k & 63 ) ) )
+          continue;
+
+        bits[ k >> 6 ] |= 1ull << ( k & 63 );
+        for ( w = k >> 6; w < words; w |= w + 1 )
+          tree[ w ]--;
+        cnt--;
+      }
+    }
+  }
+
+  blk->sum = sum;
+
+  free( bits );
+  free( tree );
+}
+
+/**
+ * Counts the odd primes of the block and adds up pi( x / p ) for the
+ * primes y < p <= sqrt( x ) whose quotient falls into the block
+ * @param bp Block pointer
+ */
+static void lmo_p2( void * bp )
+{
+  struct lmo_block * blk = (struct lmo_block*)bp;
+  struct lmo * l = blk->lmo;
+  uint64_t * bits, * pbits, f, len, lo, hi, pmin, pmax, pf, pl, plen, words;
+  uint64_t i, k, v, w, acc, sqrtx, local;
+
+  words = LMO_SEGMENT >> 6;
+  assert( bits = (uint64_t*)malloc( sizeof( uint64_t ) * words ) );
+  assert( pbits = (uint64_t*)malloc( sizeof( uint64_t ) * words ) );
+  sqrtx = lmo_isqrt( l->x );
+
+  local = 0;
+  for ( f = blk->first; f < blk->last; f += len )
+  {
+    len = blk->last - f < LMO_SEGMENT ? blk->last - f : LMO_SEGMENT;
+    lo = 2 * f;
+    hi = 2 * ( f + len );
+
+    /* Odd primes in the segment */
+    memset( bits, 0, sizeof( uint64_t ) * words );
+    for ( k = len; k < words * 64; ++k )
+      bits[ k >> 6 ] |= 1ull << ( k & 63 );
+    if ( f == 0 )
+      bits[ 0 ] |= 1;
+    for ( i = 1; i < l->a && (uint64_t)l->primes[ i ] * l->primes[ i ] < hi; ++i )
+      jobs_cross_out( (uint8_t*)bits, f, len, l->primes[ i ] );
+
+    /* Primes p with lo <= x / p < hi, largest first */
+    pmin = lmo_div( l->x, hi );
+    pmin = pmin > l->y ? pmin : l->y;
+    pmax = lo ? lmo_div( l->x, lo ) : sqrtx;
+    pmax = pmax < sqrtx ? pmax : sqrtx;
+
+    w = 0, acc = 0;
+    while ( pmax > pmin )
+    {
+      /* Odd numbers 2 * pf + 1 to 2 * pl - 1 in ( pmin, pmax ] */
+      pl = ( pmax + 1 ) / 2;
+      pf = ( pmin + 1 ) / 2;
+      pf = pl - pf > LMO_SEGMENT ? pl - LMO_SEGMENT : pf;
+      plen = pl - pf;
+
+      memset( pbits, 0, sizeof( uint64_t ) * words );
+      for ( i = 1; i < l->a && (uint64_t)l->primes[ i ] * l->primes[ i ] <= pmax; ++i )
+        jobs_cross_out( (uint8_t*)pbits, pf, plen, l->primes[ i ] );
+
+      for ( k = plen; k-- > 0; )
+      {
+        if ( pbits[ k >> 6 ] & ( 1ull << ( k & 63 ) ) )
+          continue;
+
+        /* Count the primes up to x / p, moving forward in the segment */
+        v = ( lmo_div( l->x, 2 * ( pf + k ) + 1 ) + 1 ) / 2 - f;
+        for ( ; ( w + 1 ) * 64 <= v; ++w )
+          acc += 64 - __builtin_popcountll( bits[ w ] );
+        blk->p2_sum += local + acc;
+        if ( v & 63 )
+          blk->p2_sum += __builtin_popcountll( ~bits[ w ] &
+                                               ( ( 1ull << ( v & 63 ) ) - 1 ) );
+        blk->p2_count++;
+      }
+
+      pmax = 2 * pf - 1;
+    }
+
+    for ( w = 0; w < words; ++w )
+      local += 64 - __builtin_popcountll( bits[ w ] );
+  }
+
+  blk->p2_primes = local;
+
+  free( bits );
+  free( pbits );
+}
+
+/**
+ * Splits the odd numbers up to z into blocks
+ * @param s
+ * @param count Number of blocks
+ * @return Array of blocks
+ */
+static struct lmo_block * lmo_blocks( struct state * s, int * count )
+{
+  struct lmo_block * blks;
+  struct lmo * l = s->lmo_mngr;
+  uint64_t total, size;
+  int i;
+
+  /* Odd numbers up to z, rounded up to whole segments */
+  total = l->z / 2 + 1;
+  size = total / ( s->thread_count * LMO_BLOCKS ) + 1;
+  size = ( size + LMO_SEGMENT - 1 ) / LMO_SEGMENT * LMO_SEGMENT;
+  *count = (int)( ( total + size - 1 ) / size );
+
+  assert( blks = (struct lmo_block*)malloc( sizeof( *blks ) * *count ) );
+  memset( blks, 0, sizeof( *blks ) * *count );
+  for ( i = 0; i < *count; ++i )
+  {
+    blks[ i ].lmo = l;
+    blks[ i ].first = i * size;
+    blks[ i ].last = ( i + 1 ) * size < total ? ( i + 1 ) * size : total;
+  }
+
+  return blks;
+}
+
+/**
+ * Counts primes up to x using the tables built by lmo_create:
+ * pi( x ) = S1 + S2 + a - 1 - P2, where the special leaves of S2
+ * are found by sieving the numbers up to x / y in parallel blocks
+ * @param s
+ * @return pi( x )
+ */
+uint64_t lmo_count( struct state * s )
+{
+  struct lmo * l;
+  struct lmo_block * blks;
+  uint64_t b, m, n, levels, v, b2;
+  int64_t * phi;
+  lmo_int s1, s2, p2;
+  lmo_uint sum;
+  int i, j, count, round;
+
+  if ( !( l = s->lmo_mngr ) )
+    return 0;
+
+  /* Ordinary leaves, mu( n ) * floor( x / n ) for n <= y, the
+   * quotients of the smallest n do not fit 64 bits above 2^64
+   */
+  for ( s1 = 0, n = 1; n <= l->y; ++n )
+    if ( l->mu[ n ] )
+      s1 += l->mu[ n ] * ( l->x >> 64 ? (lmo_int)( l->x / n )
+                                      : (lmo_int)lmo_div( l->x, n ) );
+
+  /* Special leaves of 2 do not need a sieve, phi( v, 0 ) = v */
+  for ( s2 = 0, m = l->y / 2 + 1; m <= l->y; ++m )
+    if ( l->mu[ m ] && ( m & 1 ) )
+      s2 -= l->mu[ m ] * (lmo_int)lmo_div( l->x, 2 * m );
+
+  /* The remaining leaves, blocks run in rounds to bound the memory */
+  blks = lmo_blocks( s, &count );
+  assert( phi = (int64_t*)malloc( sizeof( int64_t ) * ( l->a + 1 ) ) );
+  memset( phi, 0, sizeof( int64_t ) * ( l->a + 1 ) );
+
+  levels = l->a;
+  for ( i = 0; i < count; i += round )
+  {
+    round = count - i < s->thread_count ? count - i : s->thread_count;
+    for ( j = i; j < i + round; ++j )
+    {
+      v = blks[ j ].first ? lmo_isqrt( l->x / ( 2 * blks[ j ].first ) ) : l->y;
+      blks[ j ].levels = l->pi[ v < l->y ? v : l->y ];
+      blks[ j ].levels = blks[ j ].levels < levels ? blks[ j ].levels : levels;
+      assert( blks[ j ].phi = (int64_t*)malloc( sizeof( int64_t ) * ( blks[ j ].levels + 1 ) ) );
+      assert( blks[ j ].weights = (int64_t*)malloc( sizeof( int64_t ) * ( blks[ j ].levels + 1 ) ) );
+      memset( blks[ j ].phi, 0, sizeof( int64_t ) * ( blks[ j ].levels + 1 ) );
+      memset( blks[ j ].weights, 0, sizeof( int64_t ) * ( blks[ j ].levels + 1 ) );
+    }
+
+    threads_map( s, blks + i, sizeof( *blks ), round, lmo_leaves );
+
+    /* Leaves were counted from the start of their block */
+    for ( j = i; j < i + round; ++j )
+    {
+      s2 += blks[ j ].sum;
+      for ( b = 1; b < blks[ j ].levels; ++b )
+      {
+        s2 += (lmo_int)blks[ j ].weights[ b ] * phi[ b ];
+        phi[ b ] += blks[ j ].phi[ b ];
+      }
+
+      levels = blks[ j ].levels;
+      free( blks[ j ].phi );
+      free( blks[ j ].weights );
+      blks[ j ].phi = blks[ j ].weights = NULL;
+    }
+  }
+
+  free( phi );
+
+  /* P2, sum of pi( x / p ) - pi( p ) + 1 for y < p <= sqrt( x ) */
+  threads_map( s, blks, sizeof( *blks ), count, lmo_p2 );
+
+  sum = 0, n = 1, b2 = l->a;
+  for ( i = 0; i < count; ++i )
+  {
+    sum += blks[ i ].p2_sum + (lmo_uint)blks[ i ].p2_count * n;
+    n += blks[ i ].p2_primes;
+    b2 += blks[ i ].p2_count;
+  }
+
+  free( blks );
+
+  p2 = (lmo_int)sum - ( (lmo_int)b2 * ( b2 - 1 ) - (lmo_int)l->a * ( l->a - 1 ) ) / 2;
+
+  return (uint64_t)( s1 + s2 + (lmo_int)l->a - 1 - p2 );
+}
+
+/**
+ * Counts primes up to s->pi_x and prints the result
+ * @param s
+ */
+void lmo_run( struct state * s )
+{
+  struct primes_iterator it;
+  lmo_uint x;
+  uint64_t pi;
+
+  if ( !lmo_parse( s->pi_x, &x ) )
+    state_error( s, "Invalid number: %s", s->pi_x );
+
+  if ( x > LMO_MAX )
+    state_error( s, "Cannot count primes above 1e20: %s", s->pi_x );
+
+  if ( x < LMO_SEGMENT )
+  {
+    /* Too small for the leaves to make sense */
+    if ( !primes_iterator_init( &it, 0 ) )
+      state_error( s, "Cannot create iterator" );
+    for ( pi = 0; primes_iterator_next( &it ) <= x; ++pi );
+    primes_iterator_destroy( &it );
+  }
+  else
+  {
+    lmo_create( s, x );
+    pi = lmo_count( s );
+  }
+
+  printf( "pi(" );
+  lmo_print( stdout, x );
+  printf( ") = %llu\n", (unsigned long long)pi );
+}
+
+/**
+ * Checks the number of primes found by the sieve against lmo_count
+ * @param s
+ */
+void lmo_check( struct state * s )
+{
+  struct chunks * c;
+  lmo_uint x;
+  uint64_t pi;
+
+  if ( !( c = s->chunk_mngr ) || !s->lmo_mngr )
+    return;
+
+  x = (lmo_uint)s->chunk_size * s->chunk_count * 16 - 1;
+  if ( x < LMO_SEGMENT )
+    return;
+
+  lmo_create( s, x );
+  if ( ( pi = lmo_count( s ) ) != c->primes_count )
+  {
+    state_error( s, "pi(%llu) is %llu, but the sieve found %llu primes",
+                 (unsigned long long)x, (unsigned long long)pi,
+                 (unsigned long long)c->primes_count );
+  }
+
+  if ( !s->quiet )
+    printf( "pi(%llu) = %llu matches the sieve\n",
+            (unsigned long long)x, (unsigned long long)pi );
+}
@@ -0,0 +1,77 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef LMO_H
+#define LMO_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Numbers sieved at once while computing the leaves */
+#define LMO_SEGMENT ( 1 << 18 )
+
+/* Blocks handed to the threads per thread and round */
+#define LMO_BLOCKS 8
+
+/* Largest argument, 1e20, the time grows about 5 times per decade */
+#define LMO_MAX ( (lmo_uint)10000000000ull * 10000000000ull )
+
+__extension__ typedef unsigned __int128 lmo_uint;
+__extension__ typedef __int128 lmo_int;
+
+struct state;
+
+struct lmo
+{
+  /* Argument of pi */
+  lmo_uint x;
+
+  /* Leaves are split at y, a is pi(y) */
+  uint64_t y;
+  uint64_t a;
+
+  /* Special leaves are below z = x / y */
+  uint64_t z;
+
+  /* Primes up to y, starting from 2 */
+  uint32_t * primes;
+
+  /* pi(n) for n <= y */
+  uint32_t * pi;
+
+  /* Moebius function and least prime factor for n <= y */
+  int8_t * mu;
+  uint32_t * lpf;
+};
+
+int      lmo_parse( const char *, lmo_uint * );
+void     lmo_print( FILE *, lmo_uint x );
+uint64_t lmo_isqrt( lmo_uint x );
+void     lmo_create( struct state *, lmo_uint x );
+void     lmo_destroy( struct state * );
+uint64_t lmo_count( struct state * );
+void     lmo_run( struct state * );
+void     lmo_check( struct state * );
+
+#endif
@@ -0,0 +1,313 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "chunk.h"
+#include "lmo.h"
+#include "lookup.h"
+#include "state.h"
+
+/**
+ * Maps a finished sieve file
+ * @param s
+ * @param path
+ */
+void lookup_open( struct state * s, const char * path )
+{
+  struct lookup * l;
+  struct sieve_header * h;
+  struct stat st;
+
+  if ( !( l = s->lookup_mngr ) )
+    return;
+
+  if ( ( l->fd = open( path, O_RDONLY ) ) < 0 )
+  {
+    state_error( s, "Cannot open sieve file '%s'", path );
+  }
+
+  if ( fstat( l->fd, &st ) < 0 || st.st_size < SIEVE_HEADER_SIZE )
+  {
+    state_error( s, "Invalid sieve file '%s'", path );
+  }
+
+  l->size = st.st_size;
+  if ( ( l->map = mmap( 0, l->size, PROT_READ, MAP_SHARED,
+                        l->fd, 0 ) ) == MAP_FAILED )
+  {
+    l->map = NULL;
+    state_error( s, "Cannot mmap file '%s'", path );
+  }
+
+  h = (struct sieve_header*)l->map;
+  if ( memcmp( h->magic, SIEVE_MAGIC, sizeof( h->magic ) ) ||
+       SIEVE_HEADER_SIZE + h->chunk_size * h->chunk_count > l->size ||
+       h->chunks_saved > h->chunk_count )
+  {
+    state_error( s, "Invalid sieve file '%s'", path );
+  }
+
+  /* Only the saved chunks are complete */
+  l->bits = l->map + SIEVE_HEADER_SIZE;
+  l->limit = h->chunks_saved * h->chunk_size << 4ull;
+  madvise( l->map, l->size, MADV_WILLNEED );
+
+  /* pi and nth need the index */
+  if ( s->rank_file && access( s->rank_file, R_OK ) == 0 )
+  {
+    rank_open( s, &l->rank, s->rank_file, l->bits, l->limit >> 1ull );
+    l->has_rank = 1;
+  }
+}
+
+/**
+ * Unmaps the sieve file
+ * @param s
+ */
+void lookup_close( struct state * s )
+{
+  struct lookup * l;
+
+  if ( !( l = s->lookup_mngr ) )
+    return;
+
+  if ( l->has_rank )
+  {
+    rank_close( &l->rank );
+    l->has_rank = 0;
+  }
+
+  if ( l->map )
+  {
+    munmap( l->map, l->size );
+    l->map = NULL;
+  }
+
+  if ( l->fd > 0 )
+  {
+    close( l->fd );
+    l->fd = -1;
+  }
+}
+
+/**
+ * Computes a * b mod m without overflowing
+ */
+static uint64_t mul_mod( uint64_t a, uint64_t b, uint64_t m )
+{
+  return (uint64_t)( (lmo_uint)a * b % m );
+}
+
+/**
+ * Computes a ^ e mod m
+ */
+static uint64_t pow_mod( uint64_t a, uint64_t e, uint64_t m )
+{
+  uint64_t r = 1ull;
+
+  a %= m;
+  while ( e )
+  {
+    if ( e & 1ull )
+      r = mul_mod( r, a, m );
+    a = mul_mod( a, a, m );
+    e >>= 1ull;
+  }
+
+  return r;
+}
+
+/**
+ * Deterministic Miller-Rabin test, exact for every 64 bit integer
+ * @param n
+ * @return 1 if n is prime
+ */
+int miller_rabin( uint64_t n )
+{
+  static const uint64_t bases[ ] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+  uint64_t d, x;
+  int i, r, k;
+
+  if ( n < 2ull )
+    return 0;
+
+  for ( i = 0; i < 12; ++i )
+  {
+    if ( n % bases[ i ] == 0ull )
+      return n == bases[ i ];
+  }
+
+  for ( d = n - 1ull, r = 0; !( d & 1ull ); d >>= 1ull, ++r );
+
+  for ( i = 0; i < 12; ++i )
+  {
+    if ( ( x = pow_mod( bases[ i ], d, n ) ) == 1ull || x == n - 1ull )
+      continue;
+
+    for ( k = 1; k < r && ( x = mul_mod( x, x, n ) ) != n - 1ull; ++k );
+    if ( k >= r )
+      return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Checks if a number is prime
+ * @param l
+ * @param x
+ * @return 1 if x is prime
+ */
+int lookup_is_prime( const struct lookup * l, uint64_t x )
+{
+  if ( !( x & 1ull ) )
+    return x == 2ull;
+
+  if ( x >= l->limit )
+    return miller_rabin( x );
+
+  x >>= 1ull;
+  return !( l->bits[ x >> 3ull ] & ( 1 << ( x & 7ull ) ) );
+}
+
+/**
+ * Answers a batch of queries. The bitmap is prefetched a few
+ * queries ahead so the cache misses of random queries overlap
+ * @param l
+ * @param xs  Queries
+ * @param out Receives 1 for primes, 0 for composites
+ * @param n   Number of queries
+ */
+void lookup_batch( const struct lookup * l, const uint64_t * xs,
+                   uint8_t * out, size_t n )
+{
+  size_t i;
+  uint64_t x;
+
+  for ( i = 0; i < n; ++i )
+  {
+    if ( i + LOOKUP_PREFETCH < n &&
+         ( x = xs[ i + LOOKUP_PREFETCH ] ) < l->limit )
+    {
+      __builtin_prefetch( &l->bits[ x >> 4ull ] );
+    }
+
+    out[ i ] = (uint8_t)lookup_is_prime( l, xs[ i ] );
+  }
+}
+
+/**
+ * Answers the queued is_prime queries
+ * @param l
+ * @param xs
+ * @param out
+ * @param n
+ */
+static void lookup_flush( const struct lookup * l, const uint64_t * xs,
+                          uint8_t * out, size_t n )
+{
+  size_t i;
+
+  lookup_batch( l, xs, out, n );
+  for ( i = 0; i < n; ++i )
+  {
+    putchar( '0' + out[ i ] );
+    putchar( '\n' );
+  }
+}
+
+/**
+ * Reads queries from stdin. A number asks whether it is prime and
+ * prints 1 or 0, "pi <x>" prints the number of primes up to x and
+ * "nth <n>" prints the n-th prime. Numbers are answered in batches
+ * @param s
+ */
+void lookup_query( struct state * s )
+{
+  struct lookup * l;
+  uint64_t * xs, r;
+  uint8_t * out;
+  unsigned long long x;
+  char token[ 32 ];
+  size_t n;
+
+  lookup_open( s, s->query_file );
+  l = s->lookup_mngr;
+
+  assert( xs = (uint64_t*)malloc( sizeof( uint64_t ) * LOOKUP_BATCH ) );
+  assert( out = (uint8_t*)malloc( LOOKUP_BATCH ) );
+
+  n = 0;
+  while ( scanf( "%31s", token ) == 1 )
+  {
+    if ( strcmp( token, "pi" ) && strcmp( token, "nth" ) )
+    {
+      xs[ n++ ] = strtoull( token, NULL, 10 );
+      if ( n == LOOKUP_BATCH )
+      {
+        lookup_flush( l, xs, out, n );
+        n = 0;
+      }
+      continue;
+    }
+
+    /* Answers must stay in the order of the queries */
+    lookup_flush( l, xs, out, n );
+    n = 0;
+
+    if ( scanf( "%llu", &x ) != 1 )
+      break;
+
+    if ( !l->has_rank )
+    {
+      printf( "error: no rank file\n" );
+    }
+    else if ( *token == 'p' )
+    {
+      if ( ( r = rank_pi( &l->rank, x ) ) == UINT64_MAX )
+        printf( "error: %llu is not covered\n", x );
+      else
+        printf( "%llu\n", (unsigned long long)r );
+    }
+    else
+    {
+      if ( !( r = rank_nth( &l->rank, x ) ) )
+        printf( "error: prime %llu is not covered\n", x );
+      else
+        printf( "%llu\n", (unsigned long long)r );
+    }
+  }
+
+  lookup_flush( l, xs, out, n );
+
+  free( xs );
+  free( out );
+}
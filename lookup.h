@@ -0,0 +1,69 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef LOOKUP_H
+#define LOOKUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "rank.h"
+
+/* Number of queries processed per batch by the query tool */
+#define LOOKUP_BATCH ( 1 << 16 )
+
+/* Distance at which batch lookups prefetch the bitmap */
+#define LOOKUP_PREFETCH 16
+
+struct state;
+
+struct lookup
+{
+  /* File descriptor of the sieve file */
+  int fd;
+
+  /* Size of the mapping */
+  size_t size;
+
+  /* Mapped sieve file, starting with the header */
+  uint8_t * map;
+
+  /* Bitmap, bit i is set if 2i+1 is composite */
+  const uint8_t * bits;
+
+  /* Every number below this limit is covered by the bitmap */
+  uint64_t limit;
+
+  /* Rank/select index of the bitmap, if available */
+  struct rank rank;
+  int has_rank;
+};
+
+void lookup_open( struct state *, const char * path );
+void lookup_close( struct state * );
+int  lookup_is_prime( const struct lookup *, uint64_t );
+void lookup_batch( const struct lookup *, const uint64_t *, uint8_t *, size_t );
+void lookup_query( struct state * );
+int  miller_rabin( uint64_t );
+
+#endif
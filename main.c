@@ -28,7 +28,14 @@ THE SOFTWARE.
 #include <string.h>
 #include <getopt.h>
 #include <pthread.h>
+#include "iterator.h"
+#include "job.h"
+#include "pipeline.h"
+#include "plan.h"
+#include "serve.h"
 #include "state.h"
+#include "text.h"
+#include "tune.h"
 
 /**
  * Prints the commad line options
@@ -39,9 +46,89 @@ void print_options( )
   fputs( "Usage: primes [args]                                 \n", stderr );
   fputs( "  --threads=<count>      Sets the number of threads  \n", stderr );
   fputs( "  --chunks=<count>       Sets the number of chunks   \n", stderr );
-  fputs( "  --size=<size>          Sets the size of a chunk    \n", stderr );
+  fputs( "  --size=<size>[B|K|M|G]  Sets the size of a chunk,  \n", stderr );
+  fputs( "                         in MiB without a suffix     \n", stderr );
+  fputs( "  --algorithm=<name>     eratosthenes (default) or   \n", stderr );
+  fputs( "                         atkin, same output          \n", stderr );
+  fputs( "  --kernel=<name>        Forces avx512, avx2, sse42  \n", stderr );
+  fputs( "                         or generic kernels          \n", stderr );
   fputs( "  --sieve_file=<path>)   Chooses a file for the cache\n", stderr );
   fputs( "  --primes_file=<path>)  Chooses an output file      \n", stderr );
+  fputs( "  --format=<name>        binary (default) or text,   \n", stderr );
+  fputs( "                         text also writes decimals   \n", stderr );
+  fputs( "  --text_file=<path>     Chooses the decimal output  \n", stderr );
+  fputs( "  --gaps=<path>          Writes prime gap statistics \n", stderr );
+  fputs( "  --spf_file=<path>      Writes smallest factors     \n", stderr );
+  fputs( "  --reduce=<list>        Folds sum, residue:<q>,     \n", stderr );
+  fputs( "                         theta or digits over primes \n", stderr );
+  fputs( "  --mult=<path>          Writes Mertens, totient and \n", stderr );
+  fputs( "                         Liouville sums per chunk    \n", stderr );
+  fputs( "  --mu_file=<path>       Writes mu(n) as signed bytes\n", stderr );
+  fputs( "  --smooth=<B>           Writes the B-smooth numbers \n", stderr );
+  fputs( "  --smooth_file=<path>   Chooses the smooth output   \n", stderr );
+  fputs( "  --goldbach=<path>      Checks Goldbach on even n   \n", stderr );
+  fputs( "                         below the limit per chunk   \n", stderr );
+  fputs( "  --factor=<n>           Factors n using the table   \n", stderr );
+  fputs( "  --auto                 Tunes threads and chunk size\n", stderr );
+  fputs( "  --tune_file=<path>     Stores the tuning results   \n", stderr );
+  fputs( "  --quiet                Hides progress messages     \n", stderr );
+  fputs( "  --spin=<count>         Retries before parking      \n", stderr );
+  fputs( "  --from=<n>             Prints primes from n with   \n", stderr );
+  fputs( "  --count=<count>        an iterator, without files  \n", stderr );
+  fputs( "  --rank_file=<path>     Chooses a file for the index\n", stderr );
+  fputs( "  --query=<path>         Answers queries from stdin  \n", stderr );
+  fputs( "                         with a sieve file: <n> for  \n", stderr );
+  fputs( "                         is_prime, pi <x>, nth <n>   \n", stderr );
+  fputs( "  --serve=<path>         Answers isprime <n>, count  \n", stderr );
+  fputs( "                         <a> <b> and range <a> <b>   \n", stderr );
+  fputs( "                         on a Unix socket, b - a is  \n", stderr );
+  fputs( "                         below 2^30 and 2^24 for them\n", stderr );
+  fputs( "  --cache=<segments>     Segments cached by --serve  \n", stderr );
+  fputs( "  --trace=<path>         Writes a Chrome trace of the\n", stderr );
+  fputs( "                         workers                     \n", stderr );
+  fputs( "  --metrics=<path>       Serves progress metrics on  \n", stderr );
+  fputs( "                         a Unix socket               \n", stderr );
+  fputs( "  --pi=<x>               Counts primes up to x <=1e20\n", stderr );
+  fputs( "                         without a sieve, 1e16 takes \n", stderr );
+  fputs( "                         minutes, 5x more per decade \n", stderr );
+  fputs( "  --base=<x>             Sieves 16 * c * s numbers   \n", stderr );
+  fputs( "                         from x, 2^64+1e6 works, up  \n", stderr );
+  fputs( "                         to 1e20 in about 30 seconds,\n", stderr );
+  fputs( "                         writes the offsets          \n", stderr );
+  fputs( "  --memory_limit=<size>  Fits chunks and threads into\n", stderr );
+  fputs( "                         size, the cgroup limit or   \n", stderr );
+  fputs( "                         MemAvailable by default     \n", stderr );
+  fputs( "  --modulus=<q>          Only sieves the numbers a   \n", stderr );
+  fputs( "  --residue=<a>          mod q, writing their primes \n", stderr );
+  fputs( "  --encoders=<n>         Threads encoding saved      \n", stderr );
+  fputs( "                         chunks, one per worker      \n", stderr );
+  fputs( "  --queue=<n>            Chunks queued between the   \n", stderr );
+  fputs( "                         saving stages               \n", stderr );
+  fputs( "  --check_pi             Checks the sieve against pi \n", stderr );
+}
+
+
+/**
+ * Parses a size with an optional B, K, M or G suffix
+ * @param str
+ * @return Size in bytes, 0 if invalid
+ */
+uint64_t parse_size( const char * str )
+{
+  uint64_t size;
+  char * end;
+
+  size = strtoull( str, &end, 10 );
+  switch ( *end )
+  {
+    case 'B': case 'b':                 break;
+    case 'K': case 'k': size <<= 10ull; break;
+    case 'G': case 'g': size <<= 30ull; break;
+    case 'M': case 'm': case '\0':      size <<= 20ull; break;
+    default:            return 0ull;
+  }
+
+  return size;
 }
 
 
@@ -58,17 +145,58 @@ void read_options( struct state * s, int argc, char ** argv )
   s->thread_count = 8;
   s->chunk_count = 10;
   s->chunk_size = 1ll << 13;
+  s->spin_count = 64;
+  s->cache_segments = SERVE_CACHE;
+  s->queue_size = PIPELINE_QUEUE;
   s->sieve_file = strdup( "sieve.bin" );
   s->primes_file = strdup( "primes.bin" );
+  s->tune_file = strdup( "primes.tune" );
+  s->rank_file = strdup( "rank.bin" );
+  s->text_file = strdup( "primes.txt" );
+  s->smooth_file = strdup( "smooth.txt" );
 
   static struct option desc[ ] =
   {
     { "threads",     required_argument, 0, 't' },
     { "chunks",      required_argument, 0, 'c' },
     { "size",        required_argument, 0, 's' },
+    { "algorithm",   required_argument, 0, 'A' },
+    { "kernel",      required_argument, 0, 'k' },
     { "sieve_file",  required_argument, 0, 'f' },
     { "primes_file", required_argument, 0, 'o' },
-    { "help",        no_argument,       0, 'h' }
+    { "format",      required_argument, 0, 'T' },
+    { "text_file",   required_argument, 0, 'w' },
+    { "gaps",        required_argument, 0, 'g' },
+    { "spf_file",    required_argument, 0, 'p' },
+    { "reduce",      required_argument, 0, 'R' },
+    { "mult",        required_argument, 0, 'M' },
+    { "mu_file",     required_argument, 0, 'U' },
+    { "smooth",      required_argument, 0, 'B' },
+    { "smooth_file", required_argument, 0, 'b' },
+    { "goldbach",    required_argument, 0, 'G' },
+    { "factor",      required_argument, 0, 'x' },
+    { "auto",        no_argument,       0, 'a' },
+    { "tune_file",   required_argument, 0, 'u' },
+    { "quiet",       no_argument,       0, 'q' },
+    { "spin",        required_argument, 0, 'S' },
+    { "from",        required_argument, 0, 'F' },
+    { "count",       required_argument, 0, 'n' },
+    { "query",       required_argument, 0, 'Q' },
+    { "rank_file",   required_argument, 0, 'r' },
+    { "serve",       required_argument, 0, 'D' },
+    { "cache",       required_argument, 0, 'L' },
+    { "trace",       required_argument, 0, 'j' },
+    { "metrics",     required_argument, 0, 'm' },
+    { "pi",          required_argument, 0, 'P' },
+    { "check_pi",    no_argument,       0, 'C' },
+    { "base",        required_argument, 0, 'W' },
+    { "memory_limit", required_argument, 0, 'l' },
+    { "modulus",     required_argument, 0, 'K' },
+    { "residue",     required_argument, 0, 'e' },
+    { "encoders",    required_argument, 0, 'E' },
+    { "queue",       required_argument, 0, 'J' },
+    { "help",        no_argument,       0, 'h' },
+    { 0,             0,                 0, 0   }
   };
 
   while ( ( c = getopt_long( argc, argv, "t:c:s:f:h", desc, &idx ) ) != -1 )
@@ -87,7 +215,25 @@ void read_options( struct state * s, int argc, char ** argv )
       }
       case 's':
       {
-        s->chunk_size = (int64_t)atoi( optarg ) << 20;
+        s->chunk_size = parse_size( optarg );
+        break;
+      }
+      case 'A':
+      {
+        if ( !strcmp( optarg, "eratosthenes" ) )
+          s->algorithm = JOBS_ERATOSTHENES;
+        else if ( !strcmp( optarg, "atkin" ) )
+          s->algorithm = JOBS_ATKIN;
+        else
+          state_error( s, "Unknown algorithm: %s", optarg );
+        break;
+      }
+      case 'k':
+      {
+        if ( s->kernel_name )
+          free( s->kernel_name );
+
+        s->kernel_name = strdup( optarg );
         break;
       }
       case 'f':
@@ -106,6 +252,215 @@ void read_options( struct state * s, int argc, char ** argv )
         s->primes_file = strdup( optarg );
         break;
       }
+      case 'T':
+      {
+        if ( !strcmp( optarg, "binary" ) )
+          s->format = TEXT_BINARY;
+        else if ( !strcmp( optarg, "text" ) )
+          s->format = TEXT_DECIMAL;
+        else
+          state_error( s, "Unknown format: %s", optarg );
+        break;
+      }
+      case 'w':
+      {
+        if ( s->text_file )
+          free( s->text_file );
+
+        s->text_file = strdup( optarg );
+        break;
+      }
+      case 'g':
+      {
+        if ( s->gaps_file )
+          free( s->gaps_file );
+
+        s->gaps_file = strdup( optarg );
+        break;
+      }
+      case 'p':
+      {
+        if ( s->spf_file )
+          free( s->spf_file );
+
+        s->spf_file = strdup( optarg );
+        break;
+      }
+      case 'R':
+      {
+        if ( s->reduce_list )
+          free( s->reduce_list );
+
+        s->reduce_list = strdup( optarg );
+        break;
+      }
+      case 'M':
+      {
+        if ( s->mult_file )
+          free( s->mult_file );
+
+        s->mult_file = strdup( optarg );
+        break;
+      }
+      case 'U':
+      {
+        if ( s->mu_file )
+          free( s->mu_file );
+
+        s->mu_file = strdup( optarg );
+        break;
+      }
+      case 'B':
+      {
+        s->smooth_bound = strtoull( optarg, NULL, 10 );
+        break;
+      }
+      case 'b':
+      {
+        if ( s->smooth_file )
+          free( s->smooth_file );
+
+        s->smooth_file = strdup( optarg );
+        break;
+      }
+      case 'G':
+      {
+        if ( s->goldbach_file )
+          free( s->goldbach_file );
+
+        s->goldbach_file = strdup( optarg );
+        break;
+      }
+      case 'x':
+      {
+        s->factor = strtoull( optarg, NULL, 10 );
+        break;
+      }
+      case 'a':
+      {
+        s->autotune = 1;
+        break;
+      }
+      case 'u':
+      {
+        if ( s->tune_file )
+          free( s->tune_file );
+
+        s->tune_file = strdup( optarg );
+        break;
+      }
+      case 'q':
+      {
+        s->quiet = 1;
+        break;
+      }
+      case 'S':
+      {
+        s->spin_count = atoi( optarg );
+        break;
+      }
+      case 'F':
+      {
+        s->iterate_from = strtoull( optarg, NULL, 10 );
+        break;
+      }
+      case 'n':
+      {
+        s->iterate_count = strtoull( optarg, NULL, 10 );
+        break;
+      }
+      case 'Q':
+      {
+        if ( s->query_file )
+          free( s->query_file );
+
+        s->query_file = strdup( optarg );
+        break;
+      }
+      case 'r':
+      {
+        if ( s->rank_file )
+          free( s->rank_file );
+
+        s->rank_file = strdup( optarg );
+        break;
+      }
+      case 'D':
+      {
+        if ( s->serve_file )
+          free( s->serve_file );
+
+        s->serve_file = strdup( optarg );
+        break;
+      }
+      case 'L':
+      {
+        s->cache_segments = atoi( optarg );
+        break;
+      }
+      case 'j':
+      {
+        if ( s->trace_file )
+          free( s->trace_file );
+
+        s->trace_file = strdup( optarg );
+        break;
+      }
+      case 'm':
+      {
+        if ( s->metrics_file )
+          free( s->metrics_file );
+
+        s->metrics_file = strdup( optarg );
+        break;
+      }
+      case 'P':
+      {
+        if ( s->pi_x )
+          free( s->pi_x );
+
+        s->pi_x = strdup( optarg );
+        break;
+      }
+      case 'C':
+      {
+        s->check_pi = 1;
+        break;
+      }
+      case 'W':
+      {
+        if ( s->window_base )
+          free( s->window_base );
+
+        s->window_base = strdup( optarg );
+        break;
+      }
+      case 'l':
+      {
+        if ( !( s->memory_limit = parse_size( optarg ) ) )
+          state_error( s, "Invalid memory limit: %s", optarg );
+        break;
+      }
+      case 'K':
+      {
+        s->progression_modulus = strtoull( optarg, NULL, 10 );
+        break;
+      }
+      case 'e':
+      {
+        s->progression_residue = strtoull( optarg, NULL, 10 );
+        break;
+      }
+      case 'E':
+      {
+        s->encoder_count = atoi( optarg );
+        break;
+      }
+      case 'J':
+      {
+        s->queue_size = atoi( optarg );
+        break;
+      }
       case 'h':
       {
         print_options( );
@@ -123,23 +478,106 @@ void read_options( struct state * s, int argc, char ** argv )
  */
 void check_options( struct state * s )
 {
+  uint64_t a, q, t;
+
   if ( s->thread_count < 1 )
   {
     state_error( s, "Invalid thread count: %d", s->thread_count );
   }
 
+  if ( s->spin_count < 0 )
+  {
+    state_error( s, "Invalid spin count: %d", s->spin_count );
+  }
+
+  if ( s->encoder_count < 0 || s->encoder_count > s->thread_count )
+  {
+    state_error( s, "Invalid encoder count: %d", s->encoder_count );
+  }
+
+  if ( s->queue_size < 1 )
+  {
+    state_error( s, "Invalid queue size: %d", s->queue_size );
+  }
+
+  if ( s->cache_segments < 1 )
+  {
+    state_error( s, "Invalid cache size: %d", s->cache_segments );
+  }
+
   if ( s->chunk_count < 1 )
   {
     state_error( s, "Invalid chunk count: %d", s->chunk_count );
   }
 
-  if ( s->chunk_size < ( 1 << 20 ) )
+  if ( s->factor && !s->spf_file )
+  {
+    state_error( s, "--factor requires --spf_file" );
+  }
+
+  if ( s->factor >= s->chunk_count * s->chunk_size * 16 )
+  {
+    state_error( s, "%llu is not covered by the sieve",
+                 (unsigned long long)s->factor );
+  }
+
+  if ( s->chunk_size < 64 || s->chunk_size & 63 )
+  {
+    state_error( s, "Invalid chunk size: %llu, must be a multiple of 64",
+                 (unsigned long long)s->chunk_size );
+  }
+
+  if ( s->progression_residue && !s->progression_modulus )
   {
-    //state_error( s, "Invalid chunk size: %lld", s->chunk_size );
+    state_error( s, "--residue requires --modulus" );
+  }
+
+  if ( s->progression_modulus > UINT32_MAX ||
+       ( s->progression_modulus &&
+         s->progression_residue >= s->progression_modulus ) )
+  {
+    state_error( s, "Invalid progression: %llu mod %llu",
+                 (unsigned long long)s->progression_residue,
+                 (unsigned long long)s->progression_modulus );
+  }
+
+  /* Other classes hold at most one prime, which is not worth a sieve */
+  for ( a = s->progression_residue, q = s->progression_modulus; a; )
+  {
+    t = q % a;
+    q = a;
+    a = t;
+  }
+  if ( s->progression_modulus && q != 1 )
+  {
+    state_error( s, "The residue must be coprime to the modulus" );
   }
 }
 
 
+/**
+ * Prints primes using the iterator instead of the sieve
+ * @param state
+ */
+void print_primes( struct state * s )
+{
+  struct primes_iterator it;
+  uint64_t i, p;
+
+  if ( !primes_iterator_init( &it, s->iterate_from ) )
+  {
+    state_error( s, "Cannot create iterator" );
+  }
+
+  for ( i = 0; i < s->iterate_count && ( p = primes_iterator_next( &it ) ); ++i )
+  {
+    printf( "%llu\n", (unsigned long long)p );
+  }
+
+  primes_iterator_destroy( &it );
+}
+
+
 /**
  * Entry point of the application
  */
@@ -162,6 +600,54 @@ int main( int argc, char ** argv )
   // Configure
   read_options( &state, argc, argv );
   check_options( &state );
+  if ( state.iterate_count )
+  {
+    print_primes( &state );
+    state_destroy( &state );
+    return EXIT_SUCCESS;
+  }
+
+  if ( state.pi_x )
+  {
+    state_count( &state );
+    state_destroy( &state );
+    return EXIT_SUCCESS;
+  }
+
+  if ( state.query_file )
+  {
+    state_query( &state );
+    state_destroy( &state );
+    return EXIT_SUCCESS;
+  }
+
+  if ( state.serve_file )
+  {
+    state_serve( &state );
+    state_destroy( &state );
+    return EXIT_SUCCESS;
+  }
+
+  if ( state.window_base )
+  {
+    state_window( &state );
+    state_destroy( &state );
+    return EXIT_SUCCESS;
+  }
+
+  if ( state.progression_modulus )
+  {
+    state_progression( &state );
+    state_destroy( &state );
+    return EXIT_SUCCESS;
+  }
+
+  if ( state.autotune )
+  {
+    tune_run( &state );
+  }
+
+  plan_run( &state );
 
   // Run
   state_create( &state );
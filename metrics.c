@@ -0,0 +1,297 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+#include "state.h"
+
+/**
+ * Formats the metrics in the Prometheus text format
+ * @param s
+ * @param buf
+ * @param size
+ * @return Length of the text
+ */
+static int metrics_format( struct state * s, char * buf, size_t size )
+{
+  struct metrics * m = s->metrics_mngr;
+  struct timespec now;
+  uint64_t saved, bytes;
+  double elapsed, rate, eta;
+  int n;
+
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  elapsed = ( now.tv_sec - m->start.tv_sec ) +
+            ( now.tv_nsec - m->start.tv_nsec ) * 1e-9;
+
+  saved = m->chunks_saved;
+  bytes = saved * s->chunk_size;
+  rate = elapsed > 0.0 ? bytes / elapsed : 0.0;
+  eta = saved ? elapsed * ( s->chunk_count - saved ) / saved : -1.0;
+
+  n = snprintf( buf, size,
+    "# HELP primes_chunks_total Chunks to sieve.\n"
+    "# TYPE primes_chunks_total gauge\n"
+    "primes_chunks_total %d\n"
+    "# HELP primes_chunks_saved Chunks sieved and written.\n"
+    "# TYPE primes_chunks_saved counter\n"
+    "primes_chunks_saved %llu\n"
+    "# HELP primes_finished_until Every chunk up to this one is saved.\n"
+    "# TYPE primes_finished_until gauge\n"
+    "primes_finished_until %llu\n"
+    "# HELP primes_written Primes written to the output.\n"
+    "# TYPE primes_written counter\n"
+    "primes_written %llu\n"
+    "# HELP primes_jobs_done Jobs finished by the workers.\n"
+    "# TYPE primes_jobs_done counter\n"
+    "primes_jobs_done %llu\n"
+    "# HELP primes_jobs_running Jobs being run by the workers.\n"
+    "# TYPE primes_jobs_running gauge\n"
+    "primes_jobs_running %llu\n"
+    "# HELP primes_queue_depth Chunks being sieved but not saved yet.\n"
+    "# TYPE primes_queue_depth gauge\n"
+    "primes_queue_depth %llu\n"
+    "# HELP primes_sieve_bytes_per_second Bytes of the sieve saved per second.\n"
+    "# TYPE primes_sieve_bytes_per_second gauge\n"
+    "primes_sieve_bytes_per_second %.0f\n"
+    "# HELP primes_elapsed_seconds Time since the start of the run.\n"
+    "# TYPE primes_elapsed_seconds gauge\n"
+    "primes_elapsed_seconds %.3f\n"
+    "# HELP primes_eta_seconds Estimated time left, -1 before the first chunk.\n"
+    "# TYPE primes_eta_seconds gauge\n"
+    "primes_eta_seconds %.3f\n",
+    s->chunk_count,
+    (unsigned long long)saved,
+    (unsigned long long)m->finished_until,
+    (unsigned long long)m->primes_written,
+    (unsigned long long)m->jobs_done,
+    (unsigned long long)m->jobs_running,
+    (unsigned long long)m->queue_depth,
+    rate, elapsed, eta );
+
+  return n < (int)size ? n : (int)size - 1;
+}
+
+/**
+ * Writes a whole buffer to a socket
+ * @param fd
+ * @param buf
+ * @param len
+ */
+static void metrics_send( int fd, const char * buf, int len )
+{
+  ssize_t n;
+
+  while ( len > 0 )
+  {
+    if ( ( n = send( fd, buf, len, MSG_NOSIGNAL ) ) < 0 && errno == EINTR )
+      continue;
+    if ( n <= 0 )
+      break;
+
+    buf += n;
+    len -= n;
+  }
+}
+
+/**
+ * Answers the clients of the socket until the run ends. Clients which
+ * send an HTTP request get an HTTP response, others get the plain text
+ * @param sp State pointer
+ */
+static void * metrics_func( void * sp )
+{
+  struct state * s = (struct state*)sp;
+  struct metrics * m = s->metrics_mngr;
+  struct pollfd pfd;
+  char req[ 512 ], body[ 4096 ], head[ 128 ];
+  int fd, len, n;
+
+  while ( m->running )
+  {
+    pfd.fd = m->fd;
+    pfd.events = POLLIN;
+    if ( poll( &pfd, 1, METRICS_POLL ) <= 0 )
+      continue;
+
+    if ( ( fd = accept( m->fd, NULL, NULL ) ) < 0 )
+      continue;
+
+    /* Wait briefly for a request, plain clients might not send one */
+    pfd.fd = fd;
+    n = 0;
+    if ( poll( &pfd, 1, METRICS_POLL ) > 0 )
+      n = recv( fd, req, sizeof( req ) - 1, 0 );
+    req[ n > 0 ? n : 0 ] = '\0';
+
+    len = metrics_format( s, body, sizeof( body ) );
+    if ( !strncmp( req, "GET ", 4 ) )
+    {
+      n = snprintf( head, sizeof( head ),
+                    "HTTP/1.0 200 OK\r\n"
+                    "Content-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: %d\r\n\r\n", len );
+      metrics_send( fd, head, n );
+    }
+
+    metrics_send( fd, body, len );
+    close( fd );
+  }
+
+  return NULL;
+}
+
+/**
+ * Opens the socket and starts the thread answering the requests, the
+ * manager only exists if --metrics was given
+ * @param s
+ */
+void metrics_create( struct state * s )
+{
+  struct metrics * m;
+  struct sockaddr_un addr;
+
+  if ( !( m = s->metrics_mngr ) )
+    return;
+
+  m->fd = -1;
+  clock_gettime( CLOCK_MONOTONIC, &m->start );
+
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  if ( strlen( s->metrics_file ) >= sizeof( addr.sun_path ) )
+  {
+    state_error( s, "Socket path too long: %s", s->metrics_file );
+  }
+  strcpy( addr.sun_path, s->metrics_file );
+
+  /* A socket left behind by a previous run would fail the bind */
+  unlink( s->metrics_file );
+
+  if ( ( m->fd = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ||
+       bind( m->fd, (struct sockaddr*)&addr, sizeof( addr ) ) ||
+       listen( m->fd, 8 ) )
+  {
+    state_error( s, "Cannot open socket %s: %s", s->metrics_file,
+                 strerror( errno ) );
+  }
+
+  m->running = 1;
+  if ( pthread_create( &m->thread, NULL, metrics_func, s ) )
+  {
+    m->running = 0;
+    state_error( s, "Cannot create metrics thread" );
+  }
+}
+
+/**
+ * Stops the thread and removes the socket
+ * @param s
+ */
+void metrics_destroy( struct state * s )
+{
+  struct metrics * m;
+
+  if ( !( m = s->metrics_mngr ) )
+    return;
+
+  if ( m->running )
+  {
+    m->running = 0;
+    pthread_join( m->thread, NULL );
+  }
+
+  if ( m->fd >= 0 )
+  {
+    close( m->fd );
+    unlink( s->metrics_file );
+    m->fd = -1;
+  }
+}
+
+/**
+ * Counts a job started or finished by a worker
+ * @param s
+ * @param started 1 before running the job, 0 after
+ */
+void metrics_job( struct state * s, int started )
+{
+  struct metrics * m;
+
+  if ( !( m = s->metrics_mngr ) )
+    return;
+
+  if ( started )
+  {
+    __sync_fetch_and_add( &m->jobs_running, 1 );
+  }
+  else
+  {
+    __sync_fetch_and_sub( &m->jobs_running, 1 );
+    __sync_fetch_and_add( &m->jobs_done, 1 );
+  }
+}
+
+/**
+ * Records a saved chunk, called in order by the extract stage
+ * @param s
+ * @param chunks Number of chunks saved
+ * @param primes Number of primes written
+ */
+void metrics_saved( struct state * s, uint64_t chunks, uint64_t primes )
+{
+  struct metrics * m;
+
+  if ( !( m = s->metrics_mngr ) )
+    return;
+
+  m->primes_written = primes;
+  __sync_synchronize( );
+  m->chunks_saved = chunks;
+}
+
+/**
+ * Records the state of the queue, called under the queue lock
+ * @param s
+ * @param finished_until
+ * @param depth Chunks being sieved
+ */
+void metrics_queue( struct state * s, uint64_t finished_until, uint64_t depth )
+{
+  struct metrics * m;
+
+  if ( !( m = s->metrics_mngr ) )
+    return;
+
+  m->finished_until = finished_until;
+  m->queue_depth = depth;
+}
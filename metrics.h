@@ -0,0 +1,68 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Milliseconds between checks for the end of the run */
+#define METRICS_POLL 200
+
+struct state;
+
+struct metrics
+{
+  /* Listening Unix socket */
+  int fd;
+
+  /* Thread answering the requests */
+  pthread_t thread;
+
+  /* Cleared to stop the thread */
+  volatile int running;
+
+  /* Start of the run */
+  struct timespec start;
+
+  /* Counters written by the workers with atomic operations only,
+   * the metrics thread reads them without taking any lock
+   */
+  volatile uint64_t jobs_done;
+  volatile uint64_t jobs_running;
+  volatile uint64_t chunks_saved;
+  volatile uint64_t primes_written;
+  volatile uint64_t finished_until;
+  volatile uint64_t queue_depth;
+};
+
+void metrics_create( struct state * );
+void metrics_destroy( struct state * );
+void metrics_job( struct state *, int started );
+void metrics_saved( struct state *, uint64_t chunks, uint64_t primes );
+void metrics_queue( struct state *, uint64_t finished_until, uint64_t depth );
+
+#endif
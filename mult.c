@@ -0,0 +1,316 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "chunk.h"
+#include "mult.h"
+#include "state.h"
+
+/**
+ * Allocates the chunk sums, the scratch of every thread
+ * and maps the mu table if requested
+ * @param s
+ */
+void mult_create( struct state * s )
+{
+  struct mult * m;
+  size_t sz;
+  int i;
+
+  if ( !( m = s->mult_mngr ) )
+    return;
+
+  m->fd = -1;
+  if ( !s->mult_file && !s->mu_file )
+    return;
+
+  sz = sizeof( struct mult_chunk ) * ( s->chunk_count + 1 );
+  assert( m->chunks = (struct mult_chunk*)malloc( sz ) );
+  memset( m->chunks, 0, sz );
+
+  m->scratch_count = s->thread_count;
+  sz = sizeof( struct mult_scratch ) * m->scratch_count;
+  assert( m->scratch = (struct mult_scratch*)malloc( sz ) );
+  for ( i = 0; i < m->scratch_count; ++i )
+  {
+    assert( m->scratch[ i ].rest = (uint64_t*)malloc( sizeof( uint64_t ) * MULT_SEGMENT ) );
+    assert( m->scratch[ i ].phi = (uint64_t*)malloc( sizeof( uint64_t ) * MULT_SEGMENT ) );
+    assert( m->scratch[ i ].mu = (int8_t*)malloc( MULT_SEGMENT ) );
+    assert( m->scratch[ i ].lambda = (int8_t*)malloc( MULT_SEGMENT ) );
+  }
+
+  if ( !s->mu_file )
+    return;
+
+  /* One signed byte for every integer in the sieve */
+  m->size = (size_t)s->chunk_count * s->chunk_size * 16;
+  if ( ( m->fd = open( s->mu_file, O_CREAT | O_RDWR | O_TRUNC, 0666 ) ) < 0 )
+  {
+    state_error( s, "Cannot open file '%s'", s->mu_file );
+  }
+
+  if ( ftruncate( m->fd, m->size ) < 0 )
+  {
+    state_error( s, "Cannot resize file '%s'", s->mu_file );
+  }
+
+  if ( ( m->mu = mmap( 0, m->size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, m->fd, 0 ) ) == MAP_FAILED )
+  {
+    m->mu = NULL;
+    state_error( s, "Cannot mmap file '%s'", s->mu_file );
+  }
+}
+
+/**
+ * Frees the sums and the scratch, unmaps the mu table
+ * @param s
+ */
+void mult_destroy( struct state * s )
+{
+  struct mult * m;
+  int i;
+
+  if ( !( m = s->mult_mngr ) )
+    return;
+
+  if ( m->chunks )
+  {
+    free( m->chunks );
+    m->chunks = NULL;
+  }
+
+  if ( m->scratch )
+  {
+    for ( i = 0; i < m->scratch_count; ++i )
+    {
+      free( m->scratch[ i ].rest );
+      free( m->scratch[ i ].phi );
+      free( m->scratch[ i ].mu );
+      free( m->scratch[ i ].lambda );
+    }
+
+    free( m->scratch );
+    m->scratch = NULL;
+  }
+
+  if ( m->mu )
+  {
+    munmap( m->mu, m->size );
+    m->mu = NULL;
+  }
+
+  if ( m->fd >= 0 )
+  {
+    close( m->fd );
+    m->fd = -1;
+  }
+}
+
+/**
+ * Computes mu, phi and lambda for the integers of [lo, lo + len).
+ * Every prime p up to the square root of the segment visits its
+ * multiples once, then the multiples of p^2, p^3 and so on, so no
+ * division is needed. What is left of n after the small prime powers
+ * is a single prime above the square root
+ * @param s
+ * @param sc
+ * @param lo
+ * @param len
+ */
+static void mult_segment( struct state * s, struct mult_scratch * sc,
+                          uint64_t lo, uint64_t len )
+{
+  struct chunks * c = s->chunk_mngr;
+  uint64_t * rest = sc->rest, * phi = sc->phi;
+  int8_t * mu = sc->mu, * lambda = sc->lambda;
+  uint64_t i, j, p, q, hi, big, n;
+
+  for ( j = 0; j < len; ++j )
+  {
+    rest[ j ] = 1ull;
+    phi[ j ] = 1ull;
+    mu[ j ] = 1;
+    lambda[ j ] = 1;
+  }
+
+  hi = lo + len - 1;
+  for ( i = 0; i < c->primes_count; ++i )
+  {
+    p = c->primes_data[ i ];
+    if ( p * p > hi )
+      break;
+
+    /* 0 has no factorisation */
+    j = ( lo + p - 1 ) / p * p;
+    for ( j = ( j ? j : p ) - lo; j < len; j += p )
+    {
+      rest[ j ] *= p;
+      phi[ j ] *= p - 1;
+      mu[ j ] = -mu[ j ];
+      lambda[ j ] = -lambda[ j ];
+    }
+
+    for ( q = p * p; ; q *= p )
+    {
+      j = ( lo + q - 1 ) / q * q;
+      for ( j = ( j ? j : q ) - lo; j < len; j += q )
+      {
+        rest[ j ] *= p;
+        phi[ j ] *= p;
+        mu[ j ] = 0;
+        lambda[ j ] = -lambda[ j ];
+      }
+
+      if ( q > hi / p )
+        break;
+    }
+  }
+
+  /* rest now holds the part of n made of small primes. It divides n,
+   * so the quotient in doubles is off by at most a little and fixed up
+   * without the cost of an integer division
+   */
+  for ( j = 0; j < len; ++j )
+  {
+    n = lo + j;
+    if ( rest[ j ] != n && n )
+    {
+      big = (uint64_t)( (double)n / (double)rest[ j ] + 0.5 );
+      while ( big * rest[ j ] > n )
+        big--;
+      while ( big * rest[ j ] < n )
+        big++;
+      phi[ j ] *= big - 1;
+      mu[ j ] = -mu[ j ];
+      lambda[ j ] = -lambda[ j ];
+    }
+  }
+
+  if ( lo == 0 )
+  {
+    phi[ 0 ] = 0;
+    mu[ 0 ] = 0;
+    lambda[ 0 ] = 0;
+  }
+}
+
+/**
+ * Sieves mu, phi and lambda over the integers of a saved chunk. The
+ * primes up to the square root of the chunk are all saved by then
+ * @param s
+ * @param thread Index of the calling thread
+ * @param n      Chunk number
+ */
+void mult_chunk( struct state * s, int thread, int n )
+{
+  struct mult * m;
+  struct mult_scratch * sc;
+  struct mult_chunk * mc;
+  uint64_t lo, end, len, j;
+
+  if ( !( m = s->mult_mngr ) || !m->chunks )
+    return;
+
+  sc = &m->scratch[ thread ];
+  mc = &m->chunks[ n ];
+
+  end = (uint64_t)n * s->chunk_size * 16;
+  for ( lo = end - s->chunk_size * 16; lo < end; lo += len )
+  {
+    len = end - lo < MULT_SEGMENT ? end - lo : MULT_SEGMENT;
+    mult_segment( s, sc, lo, len );
+
+    for ( j = 0; j < len; ++j )
+    {
+      mc->mu += sc->mu[ j ];
+      mc->lambda += sc->lambda[ j ];
+      mc->phi += sc->phi[ j ];
+    }
+
+    if ( m->mu )
+      memcpy( m->mu + lo, sc->mu, len );
+  }
+}
+
+/**
+ * Carries the sums across the chunks in order and writes
+ * M(x), Phi(x) and L(x) at the end of every chunk
+ * @param s
+ */
+void mult_write( struct state * s )
+{
+  struct mult * m;
+  int64_t mu, lambda;
+  lmo_uint phi;
+  uint64_t x;
+  FILE * f;
+  int n;
+
+  if ( !( m = s->mult_mngr ) || !m->chunks )
+    return;
+
+  f = NULL;
+  if ( s->mult_file && !( f = fopen( s->mult_file, "w" ) ) )
+  {
+    state_error( s, "Cannot open file '%s'", s->mult_file );
+  }
+
+  if ( f )
+    fprintf( f, "# chunk <x> <mertens> <totient sum> <liouville>\n" );
+
+  mu = 0, lambda = 0, phi = 0, x = 0;
+  for ( n = 1; n <= s->chunk_count; ++n )
+  {
+    mu += m->chunks[ n ].mu;
+    lambda += m->chunks[ n ].lambda;
+    phi += m->chunks[ n ].phi;
+    x = (uint64_t)n * s->chunk_size * 16 - 1;
+
+    if ( f )
+    {
+      fprintf( f, "chunk %d %llu %lld ", n, (unsigned long long)x,
+               (long long)mu );
+      lmo_print( f, phi );
+      fprintf( f, " %lld\n", (long long)lambda );
+    }
+  }
+
+  if ( f )
+    fclose( f );
+
+  if ( !s->quiet )
+  {
+    printf( "up to %llu: M = %lld, sum of phi = ", (unsigned long long)x,
+            (long long)mu );
+    lmo_print( stdout, phi );
+    printf( ", L = %lld\n", (long long)lambda );
+  }
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef MULT_H
+#define MULT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lmo.h"
+
+/* Integers sieved at once inside a chunk, keeps the scratch in cache */
+#define MULT_SEGMENT ( 1 << 15 )
+
+struct state;
+
+struct mult_chunk
+{
+  /* Sums of mu, lambda and phi over the integers of the chunk,
+   * sums of phi overflow 64 bits past 2^32
+   */
+  int64_t mu;
+  int64_t lambda;
+  lmo_uint phi;
+};
+
+struct mult_scratch
+{
+  /* Product of the small prime powers dividing n */
+  uint64_t * rest;
+
+  /* Values being built for every n of the segment */
+  uint64_t * phi;
+  int8_t * mu;
+  int8_t * lambda;
+};
+
+struct mult
+{
+  /* Sums of every chunk, numbered from 1 */
+  struct mult_chunk * chunks;
+
+  /* Scratch of every thread */
+  struct mult_scratch * scratch;
+  int scratch_count;
+
+  /* File descriptor of the mu table, -1 if disabled */
+  int fd;
+
+  /* Size of the mu table in bytes */
+  size_t size;
+
+  /* mu(n) at index n */
+  int8_t * mu;
+};
+
+void mult_create( struct state * );
+void mult_destroy( struct state * );
+void mult_chunk( struct state *, int thread, int n );
+void mult_write( struct state * );
+
+#endif
@@ -0,0 +1,513 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "gap.h"
+#include "job.h"
+#include "mult.h"
+#include "pipeline.h"
+#include "reduce.h"
+#include "smooth.h"
+#include "state.h"
+#include "text.h"
+#include "thread.h"
+#include "trace.h"
+
+/**
+ * Number of encoders, --encoders if given, otherwise one for every
+ * worker. Encoders use the per-thread data of the workers, so there
+ * cannot be more of them than workers
+ * @param s
+ */
+int pipeline_encoders( struct state * s )
+{
+  if ( s->encoder_count < 1 || s->encoder_count > s->thread_count )
+    return s->thread_count;
+
+  return s->encoder_count;
+}
+
+/**
+ * Sets up a bell
+ * @param s
+ * @param b
+ */
+static void pipeline_bell_init( struct state * s, struct pipeline_bell * b )
+{
+  b->waiting = 0;
+  if ( pthread_mutex_init( &b->lock, NULL ) ||
+       pthread_cond_init( &b->cond, NULL ) )
+  {
+    state_error( s, "Cannot create pipeline signal" );
+  }
+}
+
+/**
+ * Wakes up the owner of a bell if it is sleeping. The fence orders
+ * the update of the ring before the check of the flag, while the
+ * owner sets the flag before checking the ring, so one of them
+ * always sees the other
+ * @param b
+ */
+static void pipeline_wake( struct pipeline_bell * b )
+{
+  if ( !b )
+    return;
+
+  __sync_synchronize( );
+  if ( b->waiting )
+  {
+    pthread_mutex_lock( &b->lock );
+    pthread_cond_signal( &b->cond );
+    pthread_mutex_unlock( &b->lock );
+  }
+}
+
+/**
+ * Spins, then sleeps on a bell while there is nothing to do
+ * @param s
+ * @param b
+ * @param idle Returns non-zero while the caller has nothing to do
+ * @param arg
+ */
+static void pipeline_wait( struct state * s, struct pipeline_bell * b,
+                           int ( * idle )( void * ), void * arg )
+{
+  int i;
+
+  for ( i = 0; i < s->spin_count; ++i )
+  {
+    if ( !idle( arg ) )
+      return;
+  }
+
+  pthread_mutex_lock( &b->lock );
+  b->waiting = 1;
+  __sync_synchronize( );
+  if ( idle( arg ) )
+    pthread_cond_wait( &b->cond, &b->lock );
+  b->waiting = 0;
+  pthread_mutex_unlock( &b->lock );
+}
+
+/**
+ * Allocates a ring of at least the given capacity
+ * @param r
+ * @param capacity
+ */
+static void pipeline_ring_init( struct pipeline_ring * r, int capacity )
+{
+  uint64_t size;
+
+  for ( size = 1; size < (uint64_t)capacity; size <<= 1 );
+  assert( r->items = (int*)malloc( sizeof( int ) * size ) );
+  r->mask = size - 1;
+  r->head = r->tail = 0;
+}
+
+static int pipeline_empty( void * rp )
+{
+  struct pipeline_ring * r = (struct pipeline_ring*)rp;
+  return r->head == r->tail;
+}
+
+static int pipeline_full( void * rp )
+{
+  struct pipeline_ring * r = (struct pipeline_ring*)rp;
+  return r->tail - r->head > r->mask;
+}
+
+/**
+ * Appends a chunk to a ring, waiting for room if it is full
+ * @param s
+ * @param r
+ * @param n
+ */
+static void pipeline_push( struct state * s, struct pipeline_ring * r, int n )
+{
+  while ( pipeline_full( r ) )
+  {
+    assert( r->producer );
+    pipeline_wait( s, r->producer, pipeline_full, r );
+  }
+
+  /* The item must be visible before the consumer sees the tail */
+  r->items[ r->tail & r->mask ] = n;
+  __sync_synchronize( );
+  r->tail++;
+  pipeline_wake( r->consumer );
+}
+
+/**
+ * Takes a chunk from a ring without waiting
+ * @param r
+ * @param n
+ * @return 0 if the ring is empty
+ */
+static int pipeline_pop( struct pipeline_ring * r, int * n )
+{
+  if ( pipeline_empty( r ) )
+    return 0;
+
+  /* The item must be read before the producer sees the room */
+  *n = r->items[ r->head & r->mask ];
+  __sync_synchronize( );
+  r->head++;
+  pipeline_wake( r->producer );
+  return 1;
+}
+
+/**
+ * Takes a chunk from a ring, waiting until there is one
+ * @param s
+ * @param st Stage owning the ring
+ * @param r
+ */
+static int pipeline_take( struct state * s, struct pipeline_stage * st,
+                          struct pipeline_ring * r )
+{
+  int n;
+
+  while ( !pipeline_pop( r, &n ) )
+    pipeline_wait( s, &st->bell, pipeline_empty, r );
+
+  return n;
+}
+
+/**
+ * Extracts the chunks in order. Saving a chunk releases the jobs
+ * depending on it and might make the next one ready, which is then
+ * saved right away. Saved chunks are handed to the encoders in turn
+ * @param sp
+ */
+static void * pipeline_extract( void * sp )
+{
+  struct pipeline_stage * st;
+  struct pipeline * p;
+  struct threads * t;
+  struct state * s;
+  struct job job;
+  uint64_t start;
+  int n, save, i;
+
+  st = (struct pipeline_stage*)sp;
+  s = st->state;
+  p = s->pipeline_mngr;
+
+  while ( ( n = pipeline_take( s, st, &p->saves ) ) )
+  {
+    /* Stages start before the workers, which are up once a chunk arrives */
+    t = s->thread_mngr;
+    for ( save = 1; save; n = job.filtered_chunk )
+    {
+      start = trace_now( s );
+      jobs_save_finished( s, n );
+      trace_event( s, s->thread_count, TRACE_SAVE, start, n, 0 );
+
+      pthread_mutex_lock( &t->queue_lock );
+      job.filtered_chunk = n;
+      jobs_finish( s, &job, &save );
+      pthread_mutex_unlock( &t->queue_lock );
+
+      pipeline_push( s, &p->encodes[ p->next ], n );
+      p->next = ( p->next + 1 ) % p->encoder_count;
+    }
+  }
+
+  for ( i = 0; i < p->encoder_count; ++i )
+    pipeline_push( s, &p->encodes[ i ], 0 );
+
+  pthread_exit( NULL );
+}
+
+/**
+ * Analyses saved chunks and converts them to text
+ * @param sp
+ */
+static void * pipeline_encode( void * sp )
+{
+  struct pipeline_stage * st;
+  struct state * s;
+  uint64_t start;
+  int n;
+
+  st = (struct pipeline_stage*)sp;
+  s = st->state;
+
+  while ( ( n = pipeline_take( s, st, st->in ) ) )
+  {
+    start = trace_now( s );
+    gaps_chunk( s, st->id, n );
+    reducers_chunk( s, st->id, n );
+    mult_chunk( s, st->id, n );
+    smooth_chunk( s, st->id, n );
+    text_encode( s, n );
+    trace_event( s, s->thread_count + 1 + st->id, TRACE_ANALYSE, start, n, 0 );
+
+    pipeline_push( s, st->out, n );
+  }
+
+  pipeline_push( s, st->out, 0 );
+  pthread_exit( NULL );
+}
+
+static int pipeline_writes_empty( void * pp )
+{
+  struct pipeline * p = (struct pipeline*)pp;
+  int i;
+
+  for ( i = 0; i < p->encoder_count; ++i )
+  {
+    if ( !pipeline_empty( &p->writes[ i ] ) )
+      return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Writes the text and smooth numbers of the encoded chunks in order
+ * and the pages of the saved ones back to the files, until every
+ * encoder is done
+ * @param sp
+ */
+static void * pipeline_write( void * sp )
+{
+  struct pipeline_stage * st;
+  struct pipeline * p;
+  struct state * s;
+  int n, i, done, any;
+
+  st = (struct pipeline_stage*)sp;
+  s = st->state;
+  p = s->pipeline_mngr;
+
+  for ( done = 0; done < p->encoder_count; )
+  {
+    for ( any = 0, i = 0; i < p->encoder_count; ++i )
+    {
+      while ( pipeline_pop( &p->writes[ i ], &n ) )
+      {
+        any = 1;
+        if ( !n )
+        {
+          done++;
+          continue;
+        }
+
+        text_write( s );
+        smooth_write( s );
+        if ( s->flush_saved )
+          chunks_flush( s, n );
+      }
+    }
+
+    if ( !any && done < p->encoder_count )
+      pipeline_wait( s, &st->bell, pipeline_writes_empty, p );
+  }
+
+  pthread_exit( NULL );
+}
+
+/**
+ * Starts a stage thread
+ * @param s
+ * @param st
+ * @param func
+ */
+static void pipeline_start( struct state * s, struct pipeline_stage * st,
+                            void * ( * func )( void * ) )
+{
+  pthread_attr_t attr;
+
+  pthread_attr_init( &attr );
+  pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE );
+  pthread_attr_setstacksize( &attr, 2 << 20 );
+
+  st->state = s;
+  if ( pthread_create( &st->thread, &attr, func, st ) )
+  {
+    pthread_attr_destroy( &attr );
+    state_error( s, "Cannot create pipeline thread" );
+  }
+
+  st->started = 1;
+  pthread_attr_destroy( &attr );
+}
+
+/**
+ * Allocates the rings and starts the stages
+ * @param s
+ */
+void pipeline_create( struct state * s )
+{
+  struct pipeline * p;
+  size_t sz;
+  int i, queue;
+
+  if ( !( p = s->pipeline_mngr ) )
+    return;
+
+  p->encoder_count = pipeline_encoders( s );
+  queue = s->queue_size > 0 ? s->queue_size : PIPELINE_QUEUE;
+
+  sz = sizeof( struct pipeline_stage ) * p->encoder_count;
+  assert( p->encoders = (struct pipeline_stage*)malloc( sz ) );
+  memset( p->encoders, 0, sz );
+
+  sz = sizeof( struct pipeline_ring ) * p->encoder_count;
+  assert( p->encodes = (struct pipeline_ring*)malloc( sz ) );
+  memset( p->encodes, 0, sz );
+  assert( p->writes = (struct pipeline_ring*)malloc( sz ) );
+  memset( p->writes, 0, sz );
+
+  pipeline_bell_init( s, &p->extract.bell );
+  pipeline_bell_init( s, &p->write.bell );
+
+  /* Workers never wait for the extractor, it has room for every
+   * chunk which can be ready at once
+   */
+  pipeline_ring_init( &p->saves, PIPELINE_SAVES );
+  p->saves.consumer = &p->extract.bell;
+
+  for ( i = 0; i < p->encoder_count; ++i )
+  {
+    pipeline_bell_init( s, &p->encoders[ i ].bell );
+    p->encoders[ i ].id = i;
+    p->encoders[ i ].in = &p->encodes[ i ];
+    p->encoders[ i ].out = &p->writes[ i ];
+
+    pipeline_ring_init( &p->encodes[ i ], queue );
+    p->encodes[ i ].producer = &p->extract.bell;
+    p->encodes[ i ].consumer = &p->encoders[ i ].bell;
+
+    pipeline_ring_init( &p->writes[ i ], queue );
+    p->writes[ i ].producer = &p->encoders[ i ].bell;
+    p->writes[ i ].consumer = &p->write.bell;
+  }
+
+  pipeline_start( s, &p->extract, pipeline_extract );
+  for ( i = 0; i < p->encoder_count; ++i )
+    pipeline_start( s, &p->encoders[ i ], pipeline_encode );
+  pipeline_start( s, &p->write, pipeline_write );
+}
+
+/**
+ * Hands a finished chunk to the extractor, the queue lock must be held
+ * @param s
+ * @param n
+ */
+void pipeline_save( struct state * s, int n )
+{
+  struct pipeline * p;
+
+  if ( !( p = s->pipeline_mngr ) )
+    return;
+
+  pipeline_push( s, &p->saves, n );
+}
+
+/**
+ * Sends the end marker down the stages once the workers have exited
+ * and waits until every chunk has gone through. Stages are started in
+ * order, if the extractor runs the marker reaches every other stage
+ * which was started, even if pipeline_create failed half way
+ * @param s
+ */
+void pipeline_drain( struct state * s )
+{
+  struct pipeline * p;
+  int i;
+
+  if ( !( p = s->pipeline_mngr ) || !p->extract.started )
+    return;
+
+  pipeline_push( s, &p->saves, 0 );
+
+  pthread_join( p->extract.thread, NULL );
+  p->extract.started = 0;
+
+  for ( i = 0; i < p->encoder_count; ++i )
+  {
+    if ( p->encoders[ i ].started )
+    {
+      pthread_join( p->encoders[ i ].thread, NULL );
+      p->encoders[ i ].started = 0;
+    }
+  }
+
+  if ( p->write.started )
+  {
+    pthread_join( p->write.thread, NULL );
+    p->write.started = 0;
+  }
+}
+
+/**
+ * Stops the stages and frees the rings
+ * @param s
+ */
+void pipeline_destroy( struct state * s )
+{
+  struct pipeline * p;
+  int i;
+
+  if ( !( p = s->pipeline_mngr ) )
+    return;
+
+  /* Workers must be gone before the end marker is pushed */
+  threads_join( s );
+  pipeline_drain( s );
+
+  if ( p->saves.items )
+  {
+    free( p->saves.items );
+    p->saves.items = NULL;
+  }
+
+  pthread_mutex_destroy( &p->extract.bell.lock );
+  pthread_cond_destroy( &p->extract.bell.cond );
+  pthread_mutex_destroy( &p->write.bell.lock );
+  pthread_cond_destroy( &p->write.bell.cond );
+
+  if ( p->encoders )
+  {
+    for ( i = 0; i < p->encoder_count; ++i )
+    {
+      pthread_mutex_destroy( &p->encoders[ i ].bell.lock );
+      pthread_cond_destroy( &p->encoders[ i ].bell.cond );
+      free( p->encodes[ i ].items );
+      free( p->writes[ i ].items );
+    }
+
+    free( p->encoders );
+    free( p->encodes );
+    free( p->writes );
+    p->encoders = NULL;
+  }
+}
@@ -0,0 +1,119 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* Default number of chunks queued in front of a stage */
+#define PIPELINE_QUEUE 64
+
+/* Chunks queued for extraction, only the next one in order is ever
+ * waiting, the rest is room for the end marker
+ */
+#define PIPELINE_SAVES 4
+
+struct state;
+
+struct pipeline_bell
+{
+  /* Guards the sleep of the thread owning the bell */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  /* Set while the owner is about to sleep or sleeping */
+  volatile int waiting;
+};
+
+struct pipeline_ring
+{
+  /* Chunk numbers, 0 marks the end of the run */
+  int * items;
+
+  /* Capacity minus one, capacities are powers of two */
+  uint64_t mask;
+
+  /* Written by the consumer and the producer only */
+  volatile uint64_t head;
+  volatile uint64_t tail;
+
+  /* Woken when the ring has room or items, the producer may be NULL
+   * if the ring can never fill up
+   */
+  struct pipeline_bell * producer;
+  struct pipeline_bell * consumer;
+};
+
+struct pipeline_stage
+{
+  /* State shared by all stages */
+  struct state * state;
+
+  /* Thread running the stage */
+  pthread_t thread;
+
+  /* Set once the thread is created, only those are joined */
+  int started;
+
+  /* Rings an encoder takes from and hands to */
+  struct pipeline_ring * in;
+  struct pipeline_ring * out;
+
+  /* Index of an encoder, used to address per-thread data */
+  int id;
+
+  /* Rung when one of the rings of the stage changes */
+  struct pipeline_bell bell;
+};
+
+struct pipeline
+{
+  /* Finished chunks, pushed by the workers under the queue lock */
+  struct pipeline_ring saves;
+
+  /* Saved chunks, one ring from the extractor to every encoder */
+  struct pipeline_ring * encodes;
+
+  /* Analysed chunks, one ring from every encoder to the writer */
+  struct pipeline_ring * writes;
+
+  /* Extractor, encoders and writer */
+  struct pipeline_stage extract;
+  struct pipeline_stage * encoders;
+  struct pipeline_stage write;
+  int encoder_count;
+
+  /* Encoder receiving the next saved chunk */
+  int next;
+};
+
+int  pipeline_encoders( struct state * );
+void pipeline_create( struct state * );
+void pipeline_destroy( struct state * );
+void pipeline_save( struct state *, int n );
+void pipeline_drain( struct state * );
+
+#endif
@@ -0,0 +1,278 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "chunk.h"
+#include "job.h"
+#include "mult.h"
+#include "plan.h"
+#include "smooth.h"
+#include "state.h"
+#include "text.h"
+#include "trace.h"
+
+/**
+ * Reads the tightest memory.max of the cgroup v2 hierarchy above
+ * the process, the limits of the ancestors apply as well
+ * @return Limit in bytes, 0 if there is none
+ */
+static uint64_t plan_cgroup( void )
+{
+  char line[ 512 ], path[ 640 ], value[ 32 ], * slash;
+  uint64_t limit, bytes;
+  FILE * f;
+
+  if ( !( f = fopen( "/proc/self/cgroup", "r" ) ) )
+    return 0;
+
+  /* The unified hierarchy is the entry with id 0 and no controllers */
+  *line = '\0';
+  while ( fgets( line, sizeof( line ), f ) && strncmp( line, "0::", 3 ) );
+  fclose( f );
+  if ( strncmp( line, "0::", 3 ) )
+    return 0;
+  line[ strcspn( line, "\n" ) ] = '\0';
+
+  for ( limit = 0; ; )
+  {
+    snprintf( path, sizeof( path ), "/sys/fs/cgroup%s/memory.max", line + 3 );
+    if ( ( f = fopen( path, "r" ) ) )
+    {
+      if ( fscanf( f, "%31s", value ) == 1 && strcmp( value, "max" ) &&
+           ( bytes = strtoull( value, NULL, 10 ) ) &&
+           ( !limit || bytes < limit ) )
+        limit = bytes;
+      fclose( f );
+    }
+
+    if ( !( slash = strrchr( line + 3, '/' ) ) || slash == line + 3 )
+      break;
+    *slash = '\0';
+  }
+
+  return limit;
+}
+
+/**
+ * Reads MemAvailable from /proc/meminfo
+ * @return Available memory in bytes, 0 if unknown
+ */
+static uint64_t plan_meminfo( void )
+{
+  char line[ 128 ];
+  unsigned long long kb;
+  FILE * f;
+
+  if ( !( f = fopen( "/proc/meminfo", "r" ) ) )
+    return 0;
+
+  kb = 0;
+  while ( fgets( line, sizeof( line ), f ) )
+  {
+    if ( sscanf( line, "MemAvailable: %llu kB", &kb ) == 1 )
+      break;
+  }
+
+  fclose( f );
+  return kb << 10ull;
+}
+
+/**
+ * Finds the memory available to the run: --memory_limit if given,
+ * otherwise the smaller of the cgroup limit and MemAvailable
+ * @param s
+ * @param source Set to a description of the limit
+ * @return Budget in bytes, UINT64_MAX if nothing is known
+ */
+uint64_t plan_budget( struct state * s, const char ** source )
+{
+  uint64_t budget, bytes;
+
+  if ( s->memory_limit )
+  {
+    *source = "--memory_limit";
+    return s->memory_limit;
+  }
+
+  budget = UINT64_MAX;
+  *source = "no limit";
+  if ( ( bytes = plan_cgroup( ) ) && bytes < budget )
+  {
+    budget = bytes;
+    *source = "cgroup memory.max";
+  }
+
+  if ( ( bytes = plan_meminfo( ) ) && bytes < budget )
+  {
+    budget = bytes;
+    *source = "MemAvailable";
+  }
+
+  return budget;
+}
+
+/**
+ * Estimates the memory resident while sieving. Only the chunks in
+ * the job table are written at once and every thread saves or reads
+ * the primes of one chunk, the rest of the mappings can be written
+ * back and dropped by the kernel
+ * @param s
+ * @param p
+ */
+static void plan_estimate( struct state * s, struct plan * p )
+{
+  uint64_t range, primes, flight;
+
+  range = (uint64_t)s->chunk_count * s->chunk_size * 16;
+  primes = chunks_bound( range ) / s->chunk_count + 1;
+  flight = s->chunk_count < s->job_columns ? s->chunk_count : s->job_columns;
+
+  p->sieve = flight * s->chunk_size;
+  p->output = s->thread_count * primes * sizeof( uint64_t );
+
+  /* 32 bits per odd number and 8 bits per number */
+  p->tables = 0;
+  if ( s->spf_file )
+    p->tables += flight * s->chunk_size * 8 * sizeof( uint32_t );
+  if ( s->mu_file )
+    p->tables += flight * s->chunk_size * 16;
+
+  p->chunks = (uint64_t)s->chunk_count * PLAN_CHUNK_BYTES;
+
+  p->threads = 0;
+  if ( s->mult_file || s->mu_file )
+    p->threads += ( 2 * sizeof( uint64_t ) + 2 ) * MULT_SEGMENT;
+  if ( s->smooth_bound )
+    p->threads += SMOOTH_SEGMENT * ( 1 + sizeof( uint64_t ) ) + SMOOTH_SEGMENT / 8;
+  if ( s->trace_file )
+    p->threads += TRACE_EVENTS * sizeof( struct trace_event );
+  if ( s->format == TEXT_DECIMAL )
+    p->threads += primes * TEXT_LINE;
+  p->threads *= s->thread_count;
+
+  p->files = (uint64_t)s->chunk_count * s->chunk_size +
+             chunks_bound( range ) * sizeof( uint64_t );
+}
+
+/**
+ * Total of an estimate
+ * @param p
+ */
+static uint64_t plan_total( const struct plan * p )
+{
+  return PLAN_RESERVE + p->sieve + p->output + p->tables + p->chunks +
+         p->threads;
+}
+
+/**
+ * Fits the sieve into the memory budget, keeping the range: the job
+ * table holds fewer chunks first, then chunks are split, which adds
+ * jobs, and threads are dropped last.
+ * Saved chunks are written back right away if the mappings exceed
+ * the budget, otherwise dirty pages would pile up against the limit
+ * @param s
+ */
+void plan_run( struct state * s )
+{
+  struct plan p, last;
+  int changed;
+
+  memset( &p, 0, sizeof( p ) );
+  if ( !s->job_columns )
+    s->job_columns = JOBS_COLUMNS;
+  p.budget = plan_budget( s, &p.source );
+  plan_estimate( s, &p );
+
+  changed = 0;
+  if ( s->job_columns > s->chunk_count )
+    s->job_columns = s->chunk_count;
+  while ( plan_total( &p ) > p.budget && s->job_columns > PLAN_MIN_COLUMNS )
+  {
+    s->job_columns--;
+    plan_estimate( s, &p );
+    changed = 1;
+  }
+
+  while ( plan_total( &p ) > p.budget &&
+          s->chunk_size >= PLAN_MIN_CHUNK << 1 && !( s->chunk_size & 127 ) &&
+          s->chunk_count <= INT_MAX >> 1 )
+  {
+    last = p;
+    s->chunk_size >>= 1;
+    s->chunk_count <<= 1;
+    plan_estimate( s, &p );
+
+    /* The records of the extra chunks can outweigh the smaller ones */
+    if ( plan_total( &p ) >= plan_total( &last ) )
+    {
+      s->chunk_size <<= 1;
+      s->chunk_count >>= 1;
+      p = last;
+      break;
+    }
+    changed = 1;
+  }
+
+  while ( plan_total( &p ) > p.budget && s->thread_count > 1 )
+  {
+    s->thread_count--;
+    plan_estimate( s, &p );
+    changed = 1;
+  }
+
+  if ( plan_total( &p ) > p.budget )
+  {
+    state_error( s, "The sieve needs %llu bytes, %llu are available (%s):\n"
+                 "  %llu for %d chunks of %llu bytes in flight\n"
+                 "  %llu for the primes being saved\n"
+                 "  %llu for their factor and mu tables\n"
+                 "  %llu for the records of %d chunks\n"
+                 "  %llu for the buffers of %d threads\n"
+                 "  %llu kept aside",
+                 (unsigned long long)plan_total( &p ),
+                 (unsigned long long)p.budget, p.source,
+                 (unsigned long long)p.sieve, s->job_columns,
+                 (unsigned long long)s->chunk_size,
+                 (unsigned long long)p.output,
+                 (unsigned long long)p.tables,
+                 (unsigned long long)p.chunks, s->chunk_count,
+                 (unsigned long long)p.threads, s->thread_count,
+                 (unsigned long long)PLAN_RESERVE );
+  }
+
+  s->flush_saved = p.files > p.budget - plan_total( &p );
+
+  if ( changed )
+  {
+    fprintf( stderr, "plan: using %d threads, %llu byte chunks, %d chunks, "
+             "%d at once in %llu of %llu bytes (%s)\n",
+             s->thread_count, (unsigned long long)s->chunk_size,
+             s->chunk_count, s->job_columns,
+             (unsigned long long)plan_total( &p ),
+             (unsigned long long)p.budget, p.source );
+  }
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdint.h>
+
+/* Memory kept aside for the code, the stacks and the allocator */
+#define PLAN_RESERVE ( 16ull << 20 )
+
+/* The job table is not shrunk below this many chunks */
+#define PLAN_MIN_COLUMNS 2
+
+/* Chunks are not split below this size to fit the budget */
+#define PLAN_MIN_CHUNK ( 4ull << 10 )
+
+/* Bookkeeping of the modules for every chunk, in bytes */
+#define PLAN_CHUNK_BYTES 256
+
+struct state;
+
+struct plan
+{
+  /* Memory available to the run */
+  uint64_t budget;
+
+  /* Where the budget comes from */
+  const char * source;
+
+  /* Bitmaps of the chunks being sieved */
+  uint64_t sieve;
+
+  /* Primes of the chunks being saved and analysed */
+  uint64_t output;
+
+  /* Factor and mu tables of the chunks being sieved */
+  uint64_t tables;
+
+  /* Records kept for every chunk */
+  uint64_t chunks;
+
+  /* Scratch of the threads */
+  uint64_t threads;
+
+  /* Whole sieve and output mappings */
+  uint64_t files;
+};
+
+uint64_t plan_budget( struct state *, const char ** source );
+void     plan_run( struct state * );
+
+#endif
@@ -0,0 +1,329 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "iterator.h"
+#include "kernel.h"
+#include "progression.h"
+#include "state.h"
+#include "thread.h"
+
+/**
+ * Inverts x modulo a prime with the extended Euclidean algorithm
+ * @param x Not divisible by p
+ * @param p
+ */
+static uint64_t progression_inverse( uint64_t x, uint64_t p )
+{
+  int64_t t, nt, q, tmp;
+  uint64_t r, nr, rtmp;
+
+  t = 0, nt = 1;
+  r = p, nr = x % p;
+  while ( nr )
+  {
+    q = (int64_t)( r / nr );
+
+    tmp = t - q * nt;
+    t = nt;
+    nt = tmp;
+
+    rtmp = r - q * nr;
+    r = nr;
+    nr = rtmp;
+  }
+
+  return t < 0 ? (uint64_t)( t + (int64_t)p ) : (uint64_t)t;
+}
+
+/**
+ * Crosses out the terms of a chunk divisible by a sieving prime, in
+ * steps of p * q over the integers, which is p over the terms
+ * @param cp
+ */
+static void progression_sieve( void * cp )
+{
+  struct progression_chunk * chunk;
+  struct progression * g;
+  struct state * s;
+  uint64_t i, k, p, count, last;
+  uint8_t * bits;
+
+  chunk = (struct progression_chunk*)cp;
+  s = chunk->state;
+  g = s->progression_mngr;
+  bits = chunk->bits;
+  count = s->chunk_size << 3ull;
+
+  /* Terms past the end of the range are never primes */
+  for ( i = g->terms > chunk->first ? g->terms - chunk->first : 0;
+        i < count; ++i )
+  {
+    bits[ i >> 3ull ] |= 1 << ( i & 7ull );
+  }
+
+  /* Neither 0 nor 1 are primes */
+  for ( i = 0; chunk->first == 0 && i < count &&
+               s->progression_residue + s->progression_modulus * i < 2; ++i )
+  {
+    bits[ i >> 3ull ] |= 1 << ( i & 7ull );
+  }
+
+  last = s->progression_residue +
+         s->progression_modulus * ( chunk->first + count - 1 );
+  for ( i = 0; i < g->prime_count; ++i )
+  {
+    p = g->primes[ i ];
+    if ( p * p > last )
+      break;
+
+    /* Multiples of p are p terms apart, starting from the CRT offset */
+    if ( ( k = g->starts[ i ] ) < chunk->first )
+      k = chunk->first + ( p - ( chunk->first - k ) % p ) % p;
+
+    for ( k -= chunk->first; k < count; k += p )
+    {
+      bits[ k >> 3ull ] |= 1 << ( k & 7ull );
+    }
+  }
+
+  chunk->primes = count - s->kernel->popcount( bits, s->chunk_size );
+}
+
+/**
+ * Writes the primes of a chunk to their place in the output
+ * @param cp
+ */
+static void progression_extract( void * cp )
+{
+  struct progression_chunk * chunk;
+  struct state * s;
+  uint64_t i, j, n, count, * out;
+  uint64_t batch[ KERNEL_BATCH + KERNEL_SLACK ];
+
+  chunk = (struct progression_chunk*)cp;
+  s = chunk->state;
+  out = s->progression_mngr->primes_data + chunk->offset;
+  count = s->chunk_size << 3ull;
+
+  for ( i = 0; i < count; i += KERNEL_BATCH )
+  {
+    /* The kernels return 2 * bit + 1, which is turned into the term */
+    n = s->kernel->extract( chunk->bits + ( i >> 3ull ), i,
+                            count - i < KERNEL_BATCH ? count - i : KERNEL_BATCH,
+                            batch );
+    for ( j = 0; j < n; ++j )
+    {
+      *out++ = s->progression_residue + s->progression_modulus *
+               ( chunk->first + ( batch[ j ] >> 1ull ) );
+    }
+  }
+}
+
+/**
+ * Finds the sieving primes and the first term each of them crosses out
+ * @param s
+ */
+void progression_create( struct state * s )
+{
+  struct primes_iterator it;
+  struct progression * g;
+  uint64_t end, p, q, a, k, capacity;
+  size_t sz;
+  int i;
+
+  if ( !( g = s->progression_mngr ) )
+    return;
+
+  q = s->progression_modulus;
+  a = s->progression_residue;
+  end = (uint64_t)s->chunk_count * s->chunk_size * 16;
+  g->terms = end > a ? ( end - a + q - 1 ) / q : 0;
+  g->primes_fd = -1;
+
+  if ( !primes_iterator_init( &it, 0 ) )
+    state_error( s, "Cannot create iterator" );
+
+  capacity = 64;
+  assert( g->primes = (uint64_t*)malloc( sizeof( uint64_t ) * capacity ) );
+  assert( g->starts = (uint64_t*)malloc( sizeof( uint64_t ) * capacity ) );
+  while ( ( p = primes_iterator_next( &it ) ) && p * p < end )
+  {
+    /* Primes dividing q divide none of the terms */
+    if ( q % p == 0 )
+      continue;
+
+    if ( g->prime_count >= capacity )
+    {
+      capacity <<= 1;
+      assert( g->primes = (uint64_t*)realloc( g->primes,
+                                              sizeof( uint64_t ) * capacity ) );
+      assert( g->starts = (uint64_t*)realloc( g->starts,
+                                              sizeof( uint64_t ) * capacity ) );
+    }
+
+    /* a + q * k = 0 mod p, from the first term at least p^2 */
+    k = ( p - a % p ) % p * progression_inverse( q, p ) % p;
+    g->starts[ g->prime_count ] = p * p > a ? ( p * p - a + q - 1 ) / q : 0;
+    g->starts[ g->prime_count ] += ( k + p - g->starts[ g->prime_count ] % p ) % p;
+    g->primes[ g->prime_count++ ] = p;
+  }
+
+  primes_iterator_destroy( &it );
+
+  if ( !g->terms )
+    state_error( s, "No term of the progression below %llu",
+                 (unsigned long long)end );
+
+  /* Every chunk holds chunk_size * 8 terms */
+  g->chunk_count = (int)( ( g->terms + ( s->chunk_size << 3ull ) - 1 ) /
+                          ( s->chunk_size << 3ull ) );
+  sz = sizeof( struct progression_chunk ) * g->chunk_count;
+  assert( g->chunks = (struct progression_chunk*)malloc( sz ) );
+  memset( g->chunks, 0, sz );
+
+  sz = s->chunk_size * g->chunk_count;
+  assert( g->bits = (uint8_t*)malloc( sz ) );
+  memset( g->bits, 0, sz );
+
+  for ( i = 0; i < g->chunk_count; ++i )
+  {
+    g->chunks[ i ].state = s;
+    g->chunks[ i ].first = ( s->chunk_size << 3ull ) * i;
+    g->chunks[ i ].bits = g->bits + s->chunk_size * i;
+  }
+}
+
+/**
+ * Frees the bitmaps and unmaps the output
+ * @param s
+ */
+void progression_destroy( struct state * s )
+{
+  struct progression * g;
+
+  if ( !( g = s->progression_mngr ) )
+    return;
+
+  if ( g->primes_data )
+  {
+    munmap( g->primes_data, g->primes_size );
+    g->primes_data = NULL;
+  }
+
+  if ( g->primes_fd >= 0 )
+  {
+    close( g->primes_fd );
+    g->primes_fd = -1;
+  }
+
+  if ( g->bits )
+  {
+    free( g->bits );
+    g->bits = NULL;
+  }
+
+  if ( g->chunks )
+  {
+    free( g->chunks );
+    g->chunks = NULL;
+  }
+
+  if ( g->starts )
+  {
+    free( g->starts );
+    g->starts = NULL;
+  }
+
+  if ( g->primes )
+  {
+    free( g->primes );
+    g->primes = NULL;
+  }
+}
+
+/**
+ * Sieves the chunks, then sizes the output from their counts
+ * and extracts every chunk to its place in parallel
+ * @param s
+ */
+void progression_run( struct state * s )
+{
+  struct progression * g;
+  uint64_t total;
+  int i;
+
+  if ( !( g = s->progression_mngr ) )
+    return;
+
+  threads_map( s, g->chunks, sizeof( struct progression_chunk ),
+               g->chunk_count, progression_sieve );
+
+  for ( total = 0, i = 0; i < g->chunk_count; ++i )
+  {
+    g->chunks[ i ].offset = total;
+    total += g->chunks[ i ].primes;
+  }
+
+  /* The counts are exact, the output is sized once */
+  g->primes_size = total * sizeof( uint64_t );
+  if ( ( g->primes_fd = open( s->primes_file, O_CREAT |
+                              O_RDWR | O_TRUNC, 0666 ) ) < 0 )
+  {
+    state_error( s, "Cannot open file '%s'", s->primes_file );
+  }
+
+  if ( ftruncate( g->primes_fd, g->primes_size ) < 0 )
+  {
+    state_error( s, "Cannot resize file '%s'", s->primes_file );
+  }
+
+  if ( total )
+  {
+    if ( ( g->primes_data = mmap( 0, g->primes_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, g->primes_fd, 0 ) ) == MAP_FAILED )
+    {
+      g->primes_data = NULL;
+      state_error( s, "Cannot mmap file '%s'", s->primes_file );
+    }
+
+    threads_map( s, g->chunks, sizeof( struct progression_chunk ),
+                 g->chunk_count, progression_extract );
+  }
+
+  if ( !s->quiet )
+  {
+    printf( "%llu primes = %llu mod %llu below %llu\n",
+            (unsigned long long)total,
+            (unsigned long long)s->progression_residue,
+            (unsigned long long)s->progression_modulus,
+            (unsigned long long)s->chunk_count * s->chunk_size * 16 );
+  }
+}
@@ -0,0 +1,86 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef PROGRESSION_H
+#define PROGRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct state;
+
+struct progression_chunk
+{
+  /* State shared by all chunks */
+  struct state * state;
+
+  /* Index of the first term, bit i stands for a + q * ( first + i ) */
+  uint64_t first;
+
+  /* Bitmap of the chunk, a set bit means composite */
+  uint8_t * bits;
+
+  /* Number of primes in the chunk */
+  uint64_t primes;
+
+  /* Position of the first prime of the chunk in the output */
+  uint64_t offset;
+};
+
+struct progression
+{
+  /* Terms a + q * k below the end of the range */
+  uint64_t terms;
+
+  /* Sieving primes which do not divide q */
+  uint64_t * primes;
+
+  /* Index of the first term divisible by each prime, at least its square */
+  uint64_t * starts;
+
+  /* Number of sieving primes */
+  uint64_t prime_count;
+
+  /* Chunks of chunk_size * 8 terms */
+  struct progression_chunk * chunks;
+  int chunk_count;
+
+  /* Bitmap of every chunk */
+  uint8_t * bits;
+
+  /* File descriptor of the output */
+  int primes_fd;
+
+  /* mmapped primes_fd */
+  uint64_t * primes_data;
+
+  /* Size of the output in bytes */
+  size_t primes_size;
+};
+
+void progression_create( struct state * );
+void progression_destroy( struct state * );
+void progression_run( struct state * );
+
+#endif
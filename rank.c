@@ -0,0 +1,327 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "chunk.h"
+#include "kernel.h"
+#include "rank.h"
+#include "state.h"
+
+/**
+ * Computes the size of the tables for a bitmap
+ * @param bits    Size of the bitmap in bits
+ * @param supers  Receives the number of superblocks
+ * @param blocks  Receives the number of blocks
+ * @param hints   Receives the maximal number of hints
+ * @return Size of the file
+ */
+static size_t rank_layout( uint64_t bits, uint64_t * supers,
+                           uint64_t * blocks, uint64_t * hints )
+{
+  *blocks = ( bits + RANK_BLOCK - 1 ) / RANK_BLOCK;
+  *supers = ( *blocks + RANK_SUPER - 1 ) / RANK_SUPER;
+  *hints = bits / RANK_SAMPLE + 1;
+
+  return RANK_HEADER_SIZE + *supers * sizeof( uint64_t ) +
+         *hints * sizeof( uint64_t ) + *blocks * sizeof( uint16_t );
+}
+
+/**
+ * Maps a rank file and sets up the table pointers
+ * @param s
+ * @param r
+ * @param path
+ * @param flags Flags passed to open
+ * @param bits  Size of the bitmap in bits
+ */
+static void rank_map( struct state * s, struct rank * r, const char * path,
+                      int flags, uint64_t bits )
+{
+  uint64_t supers, blocks, hints;
+  int prot;
+
+  r->size = rank_layout( bits, &supers, &blocks, &hints );
+  if ( ( r->fd = open( path, flags, 0666 ) ) < 0 )
+  {
+    state_error( s, "Cannot open rank file '%s'", path );
+  }
+
+  if ( ( flags & O_RDWR ) && ftruncate( r->fd, r->size ) < 0 )
+  {
+    state_error( s, "Cannot resize file '%s'", path );
+  }
+
+  prot = ( flags & O_RDWR ) ? PROT_READ | PROT_WRITE : PROT_READ;
+  if ( ( r->header = mmap( 0, r->size, prot, MAP_SHARED,
+                           r->fd, 0 ) ) == MAP_FAILED )
+  {
+    r->header = NULL;
+    state_error( s, "Cannot mmap file '%s'", path );
+  }
+
+  /* 64 bit tables first to keep them aligned */
+  r->supers = (uint64_t*)( (uint8_t*)r->header + RANK_HEADER_SIZE );
+  r->hints = r->supers + supers;
+  r->blocks = (uint16_t*)( r->hints + hints );
+}
+
+/**
+ * Creates the index built while chunks are saved
+ * @param s
+ */
+void rank_create( struct state * s )
+{
+  struct rank * r;
+  uint64_t bits;
+
+  if ( !( r = s->rank_mngr ) || !s->rank_file )
+    return;
+
+  bits = s->chunk_count * s->chunk_size << 3ull;
+  rank_map( s, r, s->rank_file, O_CREAT | O_RDWR | O_TRUNC, bits );
+
+  memcpy( r->header->magic, RANK_MAGIC, sizeof( r->header->magic ) );
+  r->header->bits = bits;
+  r->bits = s->chunk_mngr->sieve_data;
+}
+
+/**
+ * Unmaps the index
+ * @param r
+ */
+void rank_close( struct rank * r )
+{
+  if ( r->header )
+  {
+    munmap( r->header, r->size );
+    r->header = NULL;
+  }
+
+  if ( r->fd > 0 )
+  {
+    close( r->fd );
+    r->fd = -1;
+  }
+}
+
+/**
+ * Closes the index built during the run
+ * @param s
+ */
+void rank_destroy( struct state * s )
+{
+  if ( s->rank_mngr )
+    rank_close( s->rank_mngr );
+}
+
+/**
+ * Reads a word of the bitmap
+ */
+static uint64_t rank_word( const uint8_t * bits, uint64_t i )
+{
+  uint64_t word;
+
+  memcpy( &word, bits + ( i << 3ull ), sizeof( word ) );
+  return word;
+}
+
+/**
+ * Indexes a saved chunk. Chunks are saved in order, so the
+ * counts continue from the previous chunk
+ * @param s
+ * @param n Chunk number
+ */
+void rank_chunk( struct state * s, int n )
+{
+  struct rank * r;
+  struct rank_header * h;
+  uint64_t b, first, last, zeros;
+
+  if ( !( r = s->rank_mngr ) || !r->header )
+    return;
+
+  h = r->header;
+  first = ( n - 1 ) * s->chunk_size * 8 / RANK_BLOCK;
+  last = n * s->chunk_size * 8 / RANK_BLOCK;
+
+  for ( b = first; b < last; ++b )
+  {
+    if ( b % RANK_SUPER == 0 )
+      r->supers[ b / RANK_SUPER ] = h->total;
+    r->blocks[ b ] = (uint16_t)( h->total - r->supers[ b / RANK_SUPER ] );
+
+    zeros = RANK_BLOCK - s->kernel->popcount( r->bits + b * ( RANK_BLOCK / 8 ),
+                                              RANK_BLOCK / 8 );
+
+    /* Blocks containing every RANK_SAMPLE-th zero */
+    while ( h->hints_saved * RANK_SAMPLE < h->total + zeros )
+    {
+      r->hints[ h->hints_saved++ ] = b;
+    }
+
+    h->total += zeros;
+  }
+
+  h->bits_saved = last * RANK_BLOCK;
+}
+
+/**
+ * Maps an existing index for queries
+ * @param s
+ * @param r
+ * @param path
+ * @param bits  Sieve bitmap
+ * @param count Number of valid bits in the bitmap
+ */
+void rank_open( struct state * s, struct rank * r, const char * path,
+                const uint8_t * bits, uint64_t count )
+{
+  struct rank_header h;
+  int fd;
+
+  if ( ( fd = open( path, O_RDONLY ) ) < 0 )
+  {
+    state_error( s, "Cannot open rank file '%s'", path );
+  }
+
+  if ( read( fd, &h, sizeof( h ) ) != sizeof( h ) ||
+       memcmp( h.magic, RANK_MAGIC, sizeof( h.magic ) ) )
+  {
+    close( fd );
+    state_error( s, "Invalid rank file '%s'", path );
+  }
+  close( fd );
+
+  rank_map( s, r, path, O_RDONLY, h.bits );
+  if ( r->header->bits_saved > count )
+  {
+    state_error( s, "Rank file '%s' does not match the sieve", path );
+  }
+
+  r->bits = bits;
+}
+
+/**
+ * Counts the zero bits before position i
+ * @param r
+ * @param i
+ */
+static uint64_t rank_zeros( const struct rank * r, uint64_t i )
+{
+  uint64_t b, w, count, word;
+
+  /* The end of the index has no block of its own */
+  if ( i >= r->header->bits_saved )
+    return r->header->total;
+
+  b = i / RANK_BLOCK;
+  count = r->supers[ b / RANK_SUPER ] + r->blocks[ b ];
+
+  for ( w = b * ( RANK_BLOCK / 64 ); w < ( i >> 6ull ); ++w )
+  {
+    count += 64 - __builtin_popcountll( rank_word( r->bits, w ) );
+  }
+
+  if ( i & 63ull )
+  {
+    word = ~rank_word( r->bits, i >> 6ull ) & ( ( 1ull << ( i & 63ull ) ) - 1 );
+    count += __builtin_popcountll( word );
+  }
+
+  return count;
+}
+
+/**
+ * Counts the primes up to x
+ * @param r
+ * @param x Number covered by the index
+ * @return pi(x), or UINT64_MAX if x is not covered
+ */
+uint64_t rank_pi( const struct rank * r, uint64_t x )
+{
+  if ( x < 2ull )
+    return 0ull;
+
+  /* 2 is not in the bitmap, bit (x - 1) / 2 stands for the largest odd <= x */
+  if ( ( x - 1ull ) >> 1ull >= r->header->bits_saved )
+    return UINT64_MAX;
+
+  return 1ull + rank_zeros( r, ( ( x - 1ull ) >> 1ull ) + 1ull );
+}
+
+/**
+ * Finds the n-th prime, starting from nth(1) = 2
+ * @param r
+ * @param n
+ * @return The prime, or 0 if it is not covered
+ */
+uint64_t rank_nth( const struct rank * r, uint64_t n )
+{
+  const struct rank_header * h = r->header;
+  uint64_t k, lo, hi, mid, w, word, zeros;
+
+  if ( n == 0ull )
+    return 0ull;
+  if ( n == 1ull )
+    return 2ull;
+
+  /* Looking for the zero bit with rank k */
+  if ( ( k = n - 2ull ) >= h->total )
+    return 0ull;
+
+  /* The hints bracket the block, binary search between them */
+  lo = r->hints[ k / RANK_SAMPLE ];
+  hi = k / RANK_SAMPLE + 1 < h->hints_saved
+     ? r->hints[ k / RANK_SAMPLE + 1 ]
+     : h->bits_saved / RANK_BLOCK - 1;
+  while ( lo < hi )
+  {
+    mid = ( lo + hi + 1 ) >> 1ull;
+    if ( r->supers[ mid / RANK_SUPER ] + r->blocks[ mid ] <= k )
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  k -= r->supers[ lo / RANK_SUPER ] + r->blocks[ lo ];
+  for ( w = lo * ( RANK_BLOCK / 64 ); ; ++w )
+  {
+    word = ~rank_word( r->bits, w );
+    if ( k < ( zeros = __builtin_popcountll( word ) ) )
+      break;
+    k -= zeros;
+  }
+
+  /* Drop the lowest k set bits */
+  while ( k-- )
+    word &= word - 1ull;
+
+  return ( ( ( w << 6ull ) + __builtin_ctzll( word ) ) << 1ull ) + 1ull;
+}
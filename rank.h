@@ -0,0 +1,99 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef RANK_H
+#define RANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bits per block with a relative count */
+#define RANK_BLOCK 512
+
+/* Blocks per superblock with an absolute count */
+#define RANK_SUPER 128
+
+/* Number of primes between two select hints */
+#define RANK_SAMPLE 8192
+
+/* Identifies rank files */
+#define RANK_MAGIC "PRIMERK1"
+
+/* Size of the header, keeps the tables page aligned */
+#define RANK_HEADER_SIZE 4096
+
+struct state;
+
+struct rank_header
+{
+  /* RANK_MAGIC, without the terminator */
+  char magic[ 8 ];
+
+  /* Number of bits the file was sized for */
+  uint64_t bits;
+
+  /* Number of bits indexed so far, always a prefix of the bitmap */
+  uint64_t bits_saved;
+
+  /* Number of zero bits, odd primes, in the indexed prefix */
+  uint64_t total;
+
+  /* Number of select hints written */
+  uint64_t hints_saved;
+};
+
+struct rank
+{
+  /* File descriptor of the index */
+  int fd;
+
+  /* Size of the mapping */
+  size_t size;
+
+  /* Header at the start of the mapping */
+  struct rank_header * header;
+
+  /* Zero bits before each superblock */
+  uint64_t * supers;
+
+  /* Zero bits between the superblock and each block */
+  uint16_t * blocks;
+
+  /* Block holding every RANK_SAMPLE-th zero bit */
+  uint64_t * hints;
+
+  /* Sieve bitmap being indexed, bit i is set if 2i+1 is composite */
+  const uint8_t * bits;
+};
+
+void     rank_create( struct state * );
+void     rank_destroy( struct state * );
+void     rank_chunk( struct state *, int n );
+void     rank_open( struct state *, struct rank *, const char *,
+                    const uint8_t *, uint64_t bits );
+void     rank_close( struct rank * );
+uint64_t rank_pi( const struct rank *, uint64_t x );
+uint64_t rank_nth( const struct rank *, uint64_t n );
+
+#endif
@@ -0,0 +1,398 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "lmo.h"
+#include "reduce.h"
+#include "state.h"
+#include "thread.h"
+
+struct reduce_sum
+{
+  /* Number of primes */
+  uint64_t count;
+
+  /* Sum of the primes, overflows 64 bits past 2^37 */
+  lmo_uint sum;
+};
+
+/**
+ * Sum and number of primes
+ */
+static size_t reduce_sum_parse( struct state * s, struct reducer * r,
+                                const char * arg )
+{
+  if ( arg )
+    state_error( s, "sum takes no argument" );
+
+  return sizeof( struct reduce_sum );
+}
+
+static void reduce_sum_chunk( struct reducer * r, void * partial,
+                              const uint64_t * primes, uint64_t count )
+{
+  struct reduce_sum * sum = (struct reduce_sum*)partial;
+  lmo_uint total;
+  uint64_t i;
+
+  total = 0;
+  for ( i = 0; i < count; ++i )
+  {
+    total += primes[ i ];
+  }
+
+  sum->count += count;
+  sum->sum += total;
+}
+
+static void reduce_sum_merge( struct reducer * r, void * into,
+                              const void * from )
+{
+  ( (struct reduce_sum*)into )->count += ( (struct reduce_sum*)from )->count;
+  ( (struct reduce_sum*)into )->sum += ( (struct reduce_sum*)from )->sum;
+}
+
+static void reduce_sum_print( struct state * s, struct reducer * r,
+                              const void * total )
+{
+  const struct reduce_sum * sum = (const struct reduce_sum*)total;
+
+  printf( "sum %llu ", (unsigned long long)sum->count );
+  lmo_print( stdout, sum->sum );
+  putchar( '\n' );
+}
+
+/**
+ * Number of primes in every residue class modulo q
+ */
+static size_t reduce_residue_parse( struct state * s, struct reducer * r,
+                                    const char * arg )
+{
+  char * end;
+
+  if ( !arg )
+    state_error( s, "residue needs a modulus, as in residue:4" );
+
+  r->arg = strtoull( arg, &end, 10 );
+  if ( *end || r->arg < 1 || r->arg > REDUCE_MODULUS_MAX )
+    state_error( s, "Invalid modulus '%s'", arg );
+
+  return sizeof( uint64_t ) * r->arg;
+}
+
+static void reduce_residue_chunk( struct reducer * r, void * partial,
+                                  const uint64_t * primes, uint64_t count )
+{
+  uint64_t * classes = (uint64_t*)partial;
+  uint64_t q = r->arg;
+  uint64_t i;
+
+  for ( i = 0; i < count; ++i )
+  {
+    classes[ primes[ i ] % q ]++;
+  }
+}
+
+static void reduce_residue_merge( struct reducer * r, void * into,
+                                  const void * from )
+{
+  uint64_t i;
+
+  for ( i = 0; i < r->arg; ++i )
+  {
+    ( (uint64_t*)into )[ i ] += ( (const uint64_t*)from )[ i ];
+  }
+}
+
+static void reduce_residue_print( struct state * s, struct reducer * r,
+                                  const void * total )
+{
+  const uint64_t * classes = (const uint64_t*)total;
+  uint64_t i;
+
+  for ( i = 0; i < r->arg; ++i )
+  {
+    if ( classes[ i ] )
+    {
+      printf( "residue %llu %llu %llu\n", (unsigned long long)r->arg,
+              (unsigned long long)i, (unsigned long long)classes[ i ] );
+    }
+  }
+}
+
+/**
+ * Chebyshev's function, the sum of log p
+ */
+static size_t reduce_theta_parse( struct state * s, struct reducer * r,
+                                  const char * arg )
+{
+  if ( arg )
+    state_error( s, "theta takes no argument" );
+
+  return sizeof( double );
+}
+
+static void reduce_theta_chunk( struct reducer * r, void * partial,
+                                const uint64_t * primes, uint64_t count )
+{
+  double total;
+  uint64_t i;
+
+  /* Summing each chunk apart keeps the rounding error small */
+  total = 0.0;
+  for ( i = 0; i < count; ++i )
+  {
+    total += log( (double)primes[ i ] );
+  }
+
+  *(double*)partial += total;
+}
+
+static void reduce_theta_merge( struct reducer * r, void * into,
+                                const void * from )
+{
+  *(double*)into += *(const double*)from;
+}
+
+static void reduce_theta_print( struct state * s, struct reducer * r,
+                                const void * total )
+{
+  double x;
+
+  x = (double)s->chunk_count * s->chunk_size * 16.0;
+  printf( "theta %.0f %.6f %.9f\n", x, *(const double*)total,
+          *(const double*)total / x );
+}
+
+/**
+ * Number of primes ending in every decimal digit
+ */
+static size_t reduce_digits_parse( struct state * s, struct reducer * r,
+                                   const char * arg )
+{
+  if ( arg )
+    state_error( s, "digits takes no argument" );
+
+  return sizeof( uint64_t ) * 10;
+}
+
+static void reduce_digits_chunk( struct reducer * r, void * partial,
+                                 const uint64_t * primes, uint64_t count )
+{
+  uint64_t * digits = (uint64_t*)partial;
+  uint64_t i;
+
+  for ( i = 0; i < count; ++i )
+  {
+    digits[ primes[ i ] % 10 ]++;
+  }
+}
+
+static void reduce_digits_merge( struct reducer * r, void * into,
+                                 const void * from )
+{
+  int i;
+
+  for ( i = 0; i < 10; ++i )
+  {
+    ( (uint64_t*)into )[ i ] += ( (const uint64_t*)from )[ i ];
+  }
+}
+
+static void reduce_digits_print( struct state * s, struct reducer * r,
+                                 const void * total )
+{
+  const uint64_t * digits = (const uint64_t*)total;
+  int i;
+
+  for ( i = 0; i < 10; ++i )
+  {
+    if ( digits[ i ] )
+    {
+      printf( "digit %d %llu\n", i, (unsigned long long)digits[ i ] );
+    }
+  }
+}
+
+/* Every known reducer */
+static const struct reducer_type reduce_types[ ] =
+{
+  { "sum", reduce_sum_parse, reduce_sum_chunk, reduce_sum_merge,
+    reduce_sum_print },
+  { "residue", reduce_residue_parse, reduce_residue_chunk,
+    reduce_residue_merge, reduce_residue_print },
+  { "theta", reduce_theta_parse, reduce_theta_chunk, reduce_theta_merge,
+    reduce_theta_print },
+  { "digits", reduce_digits_parse, reduce_digits_chunk, reduce_digits_merge,
+    reduce_digits_print },
+};
+
+#define REDUCE_TYPES ( sizeof( reduce_types ) / sizeof( reduce_types[ 0 ] ) )
+
+/**
+ * Parses the comma separated list of reducers and allocates
+ * a zeroed partial for every reducer and thread
+ * @param s
+ */
+void reducers_create( struct state * s )
+{
+  struct reducers * r;
+  struct reducer * red;
+  char * name, * arg, * save;
+  size_t i;
+  int j;
+
+  if ( !( r = s->reduce_mngr ) || !s->reduce_list )
+    return;
+
+  r->partial_count = s->thread_count;
+
+  assert( r->names = strdup( s->reduce_list ) );
+  for ( name = strtok_r( r->names, ",", &save ); name;
+        name = strtok_r( NULL, ",", &save ) )
+  {
+    if ( ( arg = strchr( name, ':' ) ) )
+      *arg++ = '\0';
+
+    for ( i = 0; i < REDUCE_TYPES; ++i )
+    {
+      if ( !strcmp( reduce_types[ i ].name, name ) )
+        break;
+    }
+
+    if ( i == REDUCE_TYPES )
+      state_error( s, "Unknown reducer '%s'", name );
+
+    assert( r->list = (struct reducer*)realloc(
+      r->list, sizeof( struct reducer ) * ( r->count + 1 ) ) );
+    red = &r->list[ r->count++ ];
+    memset( red, 0, sizeof( struct reducer ) );
+
+    red->type = &reduce_types[ i ];
+    red->size = red->type->parse( s, red, arg );
+
+    assert( red->partials = (void**)malloc( sizeof( void* ) * r->partial_count ) );
+    for ( j = 0; j < r->partial_count; ++j )
+    {
+      assert( red->partials[ j ] = malloc( red->size ) );
+      memset( red->partials[ j ], 0, red->size );
+    }
+  }
+}
+
+/**
+ * Frees the partials
+ * @param s
+ */
+void reducers_destroy( struct state * s )
+{
+  struct reducers * r;
+  int i, j;
+
+  if ( !( r = s->reduce_mngr ) )
+    return;
+
+  if ( r->names )
+  {
+    free( r->names );
+    r->names = NULL;
+  }
+
+  if ( !r->list )
+    return;
+
+  for ( i = 0; i < r->count; ++i )
+  {
+    if ( r->list[ i ].partials )
+    {
+      for ( j = 0; j < r->partial_count; ++j )
+      {
+        free( r->list[ i ].partials[ j ] );
+      }
+
+      free( r->list[ i ].partials );
+    }
+  }
+
+  free( r->list );
+  r->list = NULL;
+  r->count = 0;
+}
+
+/**
+ * Feeds the primes of a saved chunk to every reducer while they
+ * are still in cache. Each thread folds into its own partials
+ * @param s
+ * @param thread Index of the calling thread
+ * @param n      Chunk number
+ */
+void reducers_chunk( struct state * s, int thread, int n )
+{
+  struct reducers * r;
+  struct reducer * red;
+  struct chunks * c;
+  uint64_t first;
+  int i;
+
+  if ( !( r = s->reduce_mngr ) || !r->count || !( c = s->chunk_mngr ) )
+    return;
+
+  first = c->primes_index[ n ];
+  for ( i = 0; i < r->count; ++i )
+  {
+    red = &r->list[ i ];
+    red->type->chunk( red, red->partials[ thread ], c->primes_data + first,
+                      c->primes_index[ n + 1 ] - first );
+  }
+}
+
+/**
+ * Merges the partials of every reducer and prints the results
+ * @param s
+ */
+void reducers_print( struct state * s )
+{
+  struct reducers * r;
+  struct reducer * red;
+  int i, j;
+
+  if ( !( r = s->reduce_mngr ) || !r->count )
+    return;
+
+  for ( i = 0; i < r->count; ++i )
+  {
+    red = &r->list[ i ];
+    for ( j = 1; j < r->partial_count; ++j )
+    {
+      red->type->merge( red, red->partials[ 0 ], red->partials[ j ] );
+    }
+
+    red->type->print( s, red, red->partials[ 0 ] );
+  }
+}
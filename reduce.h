@@ -0,0 +1,89 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest modulus accepted by the residue reducer */
+#define REDUCE_MODULUS_MAX 65536
+
+struct state;
+struct reducer;
+
+struct reducer_type
+{
+  /* Name used on the command line */
+  const char * name;
+
+  /* Parses the text after the colon, returns the size of a partial */
+  size_t (*parse)( struct state *, struct reducer *, const char * arg );
+
+  /* Folds the primes of a chunk into a partial */
+  void (*chunk)( struct reducer *, void * partial, const uint64_t * primes,
+                 uint64_t count );
+
+  /* Adds one partial to another */
+  void (*merge)( struct reducer *, void * into, const void * from );
+
+  /* Prints the merged result */
+  void (*print)( struct state *, struct reducer *, const void * total );
+};
+
+struct reducer
+{
+  /* Operations of the reducer */
+  const struct reducer_type * type;
+
+  /* Argument given after the colon, the modulus for residue */
+  uint64_t arg;
+
+  /* Size of a partial */
+  size_t size;
+
+  /* Partial result of every thread */
+  void ** partials;
+};
+
+struct reducers
+{
+  /* Reducers in the order they were listed */
+  struct reducer * list;
+  int count;
+
+  /* Copy of the list, split in place while parsing */
+  char * names;
+
+  /* Number of partials of every reducer */
+  int partial_count;
+};
+
+void reducers_create( struct state * );
+void reducers_destroy( struct state * );
+void reducers_chunk( struct state *, int thread, int n );
+void reducers_print( struct state * );
+
+#endif
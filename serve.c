@@ -0,0 +1,841 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "iterator.h"
+#include "job.h"
+#include "serve.h"
+#include "state.h"
+
+/* Odd numbers covered by a segment */
+#define SERVE_SPAN ( (uint64_t)SERVE_SEGMENT << 3ull )
+
+/* Set by SIGINT and SIGTERM */
+static volatile sig_atomic_t serve_stop;
+
+struct serve_buffer
+{
+  /* Text of the answers */
+  char * data;
+  size_t length;
+  size_t capacity;
+};
+
+/**
+ * Stops the daemon
+ * @param sig
+ */
+static void serve_signal( int sig )
+{
+  serve_stop = 1;
+}
+
+/**
+ * Integer square root
+ * @param x
+ * @return floor( sqrt( x ) )
+ */
+static uint64_t serve_isqrt( uint64_t x )
+{
+  uint64_t r;
+
+  r = (uint64_t)sqrtl( (long double)x );
+  while ( r > UINT32_MAX || r * r > x )
+    r--;
+  while ( r < UINT32_MAX && ( r + 1 ) * ( r + 1 ) <= x )
+    r++;
+
+  return r;
+}
+
+/**
+ * Appends text to an answer
+ * @param b
+ * @param fmt
+ */
+static void serve_printf( struct serve_buffer * b, const char * fmt, ... )
+{
+  va_list ap;
+  int n;
+
+  while ( 1 )
+  {
+    va_start( ap, fmt );
+    n = vsnprintf( b->data + b->length, b->capacity - b->length, fmt, ap );
+    va_end( ap );
+
+    if ( n >= 0 && (size_t)n < b->capacity - b->length )
+      break;
+
+    b->capacity = b->capacity ? b->capacity << 1 : 4096;
+    assert( b->data = (char*)realloc( b->data, b->capacity ) );
+  }
+
+  b->length += n;
+}
+
+/**
+ * Makes sure every prime up to the square root of high is a base prime.
+ * The limit at least doubles, so the base is rebuilt rarely
+ * @param sv
+ * @param high
+ */
+static void serve_base( struct serve * sv, uint64_t high )
+{
+  struct primes_iterator it;
+  uint64_t limit, p;
+
+  limit = serve_isqrt( high ) + 1ull;
+
+  pthread_rwlock_rdlock( &sv->base_lock );
+  p = sv->base_limit;
+  pthread_rwlock_unlock( &sv->base_lock );
+  if ( limit <= p )
+    return;
+
+  pthread_rwlock_wrlock( &sv->base_lock );
+  if ( limit > sv->base_limit )
+  {
+    if ( limit < sv->base_limit << 1ull )
+      limit = sv->base_limit << 1ull;
+    if ( limit > ( 1ull << 32 ) )
+      limit = 1ull << 32;
+
+    assert( primes_iterator_init( &it, sv->base_limit ) );
+    while ( ( p = primes_iterator_next( &it ) ) && p < limit )
+    {
+      if ( sv->base_count >= sv->base_capacity )
+      {
+        sv->base_capacity = sv->base_capacity ? sv->base_capacity << 1 : 1024;
+        assert( sv->base = (uint32_t*)realloc(
+          sv->base, sv->base_capacity * sizeof( uint32_t ) ) );
+      }
+
+      sv->base[ sv->base_count++ ] = (uint32_t)p;
+    }
+    primes_iterator_destroy( &it );
+
+    sv->base_limit = limit;
+  }
+  pthread_rwlock_unlock( &sv->base_lock );
+}
+
+/**
+ * Sieves a segment with the base primes
+ * @param sv
+ * @param seg
+ */
+static void serve_sieve( struct serve * sv, struct serve_segment * seg )
+{
+  uint64_t first, high, i;
+
+  first = seg->id * SERVE_SPAN;
+  high = ( ( first + SERVE_SPAN - 1ull ) << 1ull ) + 1ull;
+  serve_base( sv, high );
+
+  memset( seg->bits, 0, SERVE_SEGMENT );
+
+  pthread_rwlock_rdlock( &sv->base_lock );
+  for ( i = 0; i < sv->base_count &&
+              (uint64_t)sv->base[ i ] * sv->base[ i ] <= high; ++i )
+  {
+    jobs_cross_out( seg->bits, first, SERVE_SPAN, sv->base[ i ] );
+  }
+  pthread_rwlock_unlock( &sv->base_lock );
+
+  /* 1 is not a prime */
+  if ( seg->id == 0ull )
+    seg->bits[ 0 ] |= 1;
+}
+
+/**
+ * Finds the bucket of a segment
+ * @param sv
+ * @param id
+ * @return Pointer to the head of the bucket
+ */
+static struct serve_segment ** serve_bucket( struct serve * sv, uint64_t id )
+{
+  return &sv->buckets[ ( id * 0x9E3779B97F4A7C15ull ) >> ( 64 - sv->bucket_bits ) ];
+}
+
+/**
+ * Moves a segment to the front of the LRU list
+ * @param sv
+ * @param seg
+ */
+static void serve_touch( struct serve * sv, struct serve_segment * seg )
+{
+  if ( sv->lru_head == seg )
+    return;
+
+  /* Unlink */
+  if ( seg->prev )
+    seg->prev->next = seg->next;
+  if ( seg->next )
+    seg->next->prev = seg->prev;
+  if ( sv->lru_tail == seg )
+    sv->lru_tail = seg->prev;
+
+  /* Link in front */
+  seg->prev = NULL;
+  seg->next = sv->lru_head;
+  if ( sv->lru_head )
+    sv->lru_head->prev = seg;
+  sv->lru_head = seg;
+  if ( !sv->lru_tail )
+    sv->lru_tail = seg;
+}
+
+/**
+ * Returns a sieved segment and pins it until serve_release. A miss
+ * evicts the least recently used segment nobody is reading and is
+ * sieved by the calling worker, outside the cache lock. Workers asking
+ * for a segment being sieved wait for it instead of sieving it again
+ * @param sv
+ * @param id
+ * @return Pinned segment
+ */
+static struct serve_segment * serve_acquire( struct serve * sv, uint64_t id )
+{
+  struct serve_segment * seg, ** link;
+
+  pthread_mutex_lock( &sv->cache_lock );
+
+  for ( seg = *serve_bucket( sv, id ); seg; seg = seg->chain )
+  {
+    if ( seg->id == id )
+    {
+      sv->hits++;
+      seg->refs++;
+      serve_touch( sv, seg );
+      while ( !seg->ready )
+        pthread_cond_wait( &sv->cache_cond, &sv->cache_lock );
+
+      pthread_mutex_unlock( &sv->cache_lock );
+      return seg;
+    }
+  }
+
+  sv->misses++;
+  if ( sv->segment_count < sv->segment_capacity )
+  {
+    seg = &sv->segments[ sv->segment_count++ ];
+    assert( seg->bits = (uint8_t*)malloc( SERVE_SEGMENT ) );
+  }
+  else
+  {
+    /* Every worker pins at most one segment and there are more
+     * segments than workers, so an unpinned one always exists
+     */
+    for ( seg = sv->lru_tail; seg->refs; seg = seg->prev );
+
+    for ( link = serve_bucket( sv, seg->id ); *link != seg;
+          link = &( *link )->chain );
+    *link = seg->chain;
+  }
+
+  seg->id = id;
+  seg->refs = 1;
+  seg->ready = 0;
+  link = serve_bucket( sv, id );
+  seg->chain = *link;
+  *link = seg;
+  serve_touch( sv, seg );
+
+  pthread_mutex_unlock( &sv->cache_lock );
+
+  serve_sieve( sv, seg );
+
+  pthread_mutex_lock( &sv->cache_lock );
+  seg->ready = 1;
+  pthread_cond_broadcast( &sv->cache_cond );
+  pthread_mutex_unlock( &sv->cache_lock );
+
+  return seg;
+}
+
+/**
+ * Unpins a segment
+ * @param sv
+ * @param seg
+ */
+static void serve_release( struct serve * sv, struct serve_segment * seg )
+{
+  pthread_mutex_lock( &sv->cache_lock );
+  seg->refs--;
+  pthread_mutex_unlock( &sv->cache_lock );
+}
+
+/**
+ * Counts the clear bits of a bitmap between two positions
+ * @param bits
+ * @param from First bit
+ * @param to   Bit after the last one
+ * @return Number of primes
+ */
+static uint64_t serve_count_bits( const uint8_t * bits, uint64_t from,
+                                  uint64_t to )
+{
+  const uint64_t * words = (const uint64_t*)bits;
+  uint64_t w, word, count;
+
+  count = 0ull;
+  for ( w = from >> 6ull; w << 6ull < to; ++w )
+  {
+    word = ~words[ w ];
+    if ( w == from >> 6ull )
+      word &= ~0ull << ( from & 63ull );
+    if ( ( w + 1ull ) << 6ull > to )
+      word &= ~0ull >> ( 64ull - ( to & 63ull ) );
+
+    count += __builtin_popcountll( word );
+  }
+
+  return count;
+}
+
+/**
+ * Walks the odd numbers of [a, b] segment by segment, either counting
+ * the primes or listing them in the answer. Stops early if the daemon
+ * is shutting down
+ * @param sv
+ * @param a
+ * @param b
+ * @param out Answer the primes are listed in, NULL to count them
+ * @return Number of primes
+ */
+static uint64_t serve_walk( struct serve * sv, uint64_t a, uint64_t b,
+                            struct serve_buffer * out )
+{
+  struct serve_segment * seg;
+  const uint64_t * words;
+  uint64_t lo, hi, id, first, from, to, w, word, count;
+
+  count = 0ull;
+  if ( a > b )
+    return 0ull;
+
+  if ( a <= 2ull && 2ull <= b )
+  {
+    count++;
+    if ( out )
+      serve_printf( out, " 2" );
+  }
+
+  /* Odd indices of the odd numbers in [a, b] */
+  lo = a >> 1ull;
+  hi = ( b >> 1ull ) + ( b & 1ull );
+
+  for ( id = lo / SERVE_SPAN; lo < hi && sv->running; ++id )
+  {
+    first = id * SERVE_SPAN;
+    from = lo - first;
+    to = hi - first < SERVE_SPAN ? hi - first : SERVE_SPAN;
+
+    seg = serve_acquire( sv, id );
+    if ( !out )
+    {
+      count += serve_count_bits( seg->bits, from, to );
+    }
+    else
+    {
+      words = (const uint64_t*)seg->bits;
+      for ( w = from >> 6ull; w << 6ull < to; ++w )
+      {
+        word = ~words[ w ];
+        if ( w == from >> 6ull )
+          word &= ~0ull << ( from & 63ull );
+        if ( ( w + 1ull ) << 6ull > to )
+          word &= ~0ull >> ( 64ull - ( to & 63ull ) );
+
+        for ( ; word; word &= word - 1ull )
+        {
+          serve_printf( out, " %llu", (unsigned long long)(
+            ( ( first + ( w << 6ull ) + __builtin_ctzll( word ) ) << 1ull ) + 1ull ) );
+          count++;
+        }
+      }
+    }
+    serve_release( sv, seg );
+
+    lo = first + to;
+  }
+
+  return count;
+}
+
+/**
+ * Answers a single request line
+ * @param s
+ * @param line
+ * @param out
+ */
+static void serve_request( struct state * s, char * line,
+                           struct serve_buffer * out )
+{
+  struct serve * sv = s->serve_mngr;
+  unsigned long long a, b;
+  char cmd[ 16 ];
+  size_t start;
+  int n;
+
+  n = sscanf( line, "%15s %llu %llu", cmd, &a, &b );
+  if ( n < 1 )
+    return;
+
+  if ( !strcmp( cmd, "isprime" ) && n == 2 )
+  {
+    serve_printf( out, "%d\n", a == 2ull ||
+                  ( ( a & 1ull ) && serve_walk( sv, a, a, NULL ) ) );
+  }
+  else if ( !strcmp( cmd, "count" ) && n == 3 )
+  {
+    if ( a <= b && b - a >= SERVE_COUNT_MAX )
+    {
+      serve_printf( out, "error: counts are limited to %llu numbers\n",
+                    (unsigned long long)SERVE_COUNT_MAX );
+      return;
+    }
+
+    serve_printf( out, "%llu\n",
+                  (unsigned long long)serve_walk( sv, a, b, NULL ) );
+  }
+  else if ( !strcmp( cmd, "range" ) && n == 3 )
+  {
+    if ( a <= b && b - a >= SERVE_RANGE_MAX )
+    {
+      serve_printf( out, "error: ranges are limited to %llu numbers\n",
+                    (unsigned long long)SERVE_RANGE_MAX );
+      return;
+    }
+
+    /* Primes are listed with a leading space, drop the first one */
+    start = out->length;
+    if ( serve_walk( sv, a, b, out ) )
+    {
+      memmove( out->data + start, out->data + start + 1,
+               out->length - start - 1 );
+      out->length--;
+    }
+    serve_printf( out, "\n" );
+  }
+  else if ( !strcmp( cmd, "stats" ) )
+  {
+    pthread_mutex_lock( &sv->cache_lock );
+    serve_printf( out, "segments %d hits %llu misses %llu\n",
+                  sv->segment_count, (unsigned long long)sv->hits,
+                  (unsigned long long)sv->misses );
+    pthread_mutex_unlock( &sv->cache_lock );
+  }
+  else
+  {
+    serve_printf( out, "error: unknown request\n" );
+  }
+}
+
+/**
+ * Writes a whole buffer to a socket
+ * @param fd
+ * @param buf
+ * @param len
+ * @return 0 if the client went away
+ */
+static int serve_send( int fd, const char * buf, size_t len )
+{
+  ssize_t n;
+
+  while ( len > 0 )
+  {
+    if ( ( n = send( fd, buf, len, MSG_NOSIGNAL ) ) < 0 && errno == EINTR )
+      continue;
+    if ( n <= 0 )
+      return 0;
+
+    buf += n;
+    len -= n;
+  }
+
+  return 1;
+}
+
+/**
+ * Answers the complete request lines a client has sent so far, then
+ * hands the client back to the poller or closes it if it hung up
+ * @param s
+ * @param c
+ * @param out Buffer of the answers, reused across clients
+ */
+static void serve_answer( struct state * s, struct serve_client * c,
+                          struct serve_buffer * out )
+{
+  struct serve * sv = s->serve_mngr;
+  char * end, * start;
+  ssize_t n;
+  int open;
+
+  open = 0;
+  n = recv( c->fd, c->line + c->fill, sizeof( c->line ) - c->fill - 1, 0 );
+  if ( n > 0 || ( n < 0 && ( errno == EINTR || errno == EAGAIN ) ) )
+  {
+    c->fill += n > 0 ? n : 0;
+    c->line[ c->fill ] = '\0';
+
+    /* Answer every complete line, keep the rest for the next read */
+    out->length = 0;
+    for ( start = c->line; ( end = strchr( start, '\n' ) ); start = end + 1 )
+    {
+      *end = '\0';
+      serve_request( s, start, out );
+    }
+
+    c->fill -= start - c->line;
+    memmove( c->line, start, c->fill );
+    if ( c->fill == sizeof( c->line ) - 1 )
+    {
+      serve_printf( out, "error: request too long\n" );
+      c->fill = 0;
+    }
+
+    /* Answers cut short by the end of the daemon are not sent */
+    open = sv->running &&
+           ( !out->length || serve_send( c->fd, out->data, out->length ) );
+  }
+
+  pthread_mutex_lock( &sv->queue_lock );
+  if ( !open )
+  {
+    close( c->fd );
+    c->fd = -1;
+  }
+  c->busy = 0;
+  pthread_mutex_unlock( &sv->queue_lock );
+
+  /* The poller must watch the client again, a full pipe wakes it anyway */
+  if ( open )
+    while ( write( sv->wake[ 1 ], "", 1 ) < 0 && errno == EINTR );
+}
+
+/**
+ * Takes clients with a pending request off the queue and answers them,
+ * a worker is only held for the duration of a request
+ * @param sp State pointer
+ */
+static void * serve_func( void * sp )
+{
+  struct state * s = (struct state*)sp;
+  struct serve * sv = s->serve_mngr;
+  struct serve_buffer out;
+  struct serve_client * c;
+
+  memset( &out, 0, sizeof( out ) );
+  while ( 1 )
+  {
+    pthread_mutex_lock( &sv->queue_lock );
+    while ( sv->running && !sv->queue_size )
+      pthread_cond_wait( &sv->queue_cond, &sv->queue_lock );
+
+    if ( !sv->running )
+    {
+      pthread_mutex_unlock( &sv->queue_lock );
+      break;
+    }
+
+    c = &sv->clients[ sv->queue[ sv->queue_head ] ];
+    sv->queue_head = ( sv->queue_head + 1 ) % SERVE_CLIENTS;
+    sv->queue_size--;
+    pthread_mutex_unlock( &sv->queue_lock );
+
+    serve_answer( s, c, &out );
+  }
+
+  free( out.data );
+  return NULL;
+}
+
+/**
+ * Allocates the cache, opens the socket and starts the workers
+ * @param s
+ */
+void serve_create( struct state * s )
+{
+  struct serve * sv;
+  struct sockaddr_un addr;
+  size_t sz;
+  int i;
+
+  if ( !( sv = s->serve_mngr ) )
+    return;
+
+  sv->fd = -1;
+  sv->wake[ 0 ] = sv->wake[ 1 ] = -1;
+  for ( i = 0; i < SERVE_CLIENTS; ++i )
+    sv->clients[ i ].fd = -1;
+
+  if ( pthread_mutex_init( &sv->queue_lock, NULL ) ||
+       pthread_cond_init( &sv->queue_cond, NULL ) ||
+       pthread_mutex_init( &sv->cache_lock, NULL ) ||
+       pthread_cond_init( &sv->cache_cond, NULL ) ||
+       pthread_rwlock_init( &sv->base_lock, NULL ) )
+  {
+    state_error( s, "Cannot create daemon locks" );
+  }
+
+  /* The iterator provides 2, the base starts at 3 */
+  sv->base_limit = 3ull;
+
+  /* Every worker pins at most one segment at a time */
+  sv->segment_capacity = s->cache_segments;
+  if ( sv->segment_capacity <= s->thread_count )
+    sv->segment_capacity = s->thread_count + 1;
+
+  sz = sizeof( struct serve_segment ) * sv->segment_capacity;
+  assert( sv->segments = (struct serve_segment*)malloc( sz ) );
+  memset( sv->segments, 0, sz );
+
+  for ( sv->bucket_bits = 1;
+        ( 1 << sv->bucket_bits ) < sv->segment_capacity; ++sv->bucket_bits );
+  sz = sizeof( struct serve_segment* ) << sv->bucket_bits;
+  assert( sv->buckets = (struct serve_segment**)malloc( sz ) );
+  memset( sv->buckets, 0, sz );
+
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  if ( strlen( s->serve_file ) >= sizeof( addr.sun_path ) )
+  {
+    state_error( s, "Socket path too long: %s", s->serve_file );
+  }
+  strcpy( addr.sun_path, s->serve_file );
+
+  /* A socket left behind by a previous run would fail the bind */
+  unlink( s->serve_file );
+
+  if ( ( sv->fd = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ||
+       bind( sv->fd, (struct sockaddr*)&addr, sizeof( addr ) ) ||
+       listen( sv->fd, SERVE_QUEUE ) )
+  {
+    state_error( s, "Cannot open socket %s: %s", s->serve_file,
+                 strerror( errno ) );
+  }
+
+  if ( pipe( sv->wake ) ||
+       fcntl( sv->wake[ 0 ], F_SETFL, O_NONBLOCK ) ||
+       fcntl( sv->wake[ 1 ], F_SETFL, O_NONBLOCK ) )
+  {
+    state_error( s, "Cannot create pipe: %s", strerror( errno ) );
+  }
+
+  sv->running = 1;
+  assert( sv->workers = (pthread_t*)malloc( sizeof( pthread_t ) * s->thread_count ) );
+  for ( i = 0; i < s->thread_count; ++i )
+  {
+    if ( pthread_create( &sv->workers[ i ], NULL, serve_func, s ) )
+    {
+      state_error( s, "Cannot create worker %d", i );
+    }
+    sv->worker_count++;
+  }
+}
+
+/**
+ * Stops the workers, closes the pending connections and frees the cache
+ * @param s
+ */
+void serve_destroy( struct state * s )
+{
+  struct serve * sv;
+  int i;
+
+  if ( !( sv = s->serve_mngr ) )
+    return;
+
+  if ( sv->workers )
+  {
+    pthread_mutex_lock( &sv->queue_lock );
+    sv->running = 0;
+    pthread_cond_broadcast( &sv->queue_cond );
+    pthread_mutex_unlock( &sv->queue_lock );
+
+    for ( i = 0; i < sv->worker_count; ++i )
+      pthread_join( sv->workers[ i ], NULL );
+
+    free( sv->workers );
+    sv->workers = NULL;
+  }
+
+  /* Queued clients are closed along with the idle ones */
+  sv->queue_size = 0;
+  for ( i = 0; i < SERVE_CLIENTS; ++i )
+  {
+    if ( sv->clients[ i ].fd >= 0 )
+    {
+      close( sv->clients[ i ].fd );
+      sv->clients[ i ].fd = -1;
+    }
+  }
+
+  for ( i = 0; i < 2; ++i )
+  {
+    if ( sv->wake[ i ] >= 0 )
+    {
+      close( sv->wake[ i ] );
+      sv->wake[ i ] = -1;
+    }
+  }
+
+  if ( sv->fd >= 0 )
+  {
+    close( sv->fd );
+    unlink( s->serve_file );
+    sv->fd = -1;
+  }
+
+  if ( sv->segments )
+  {
+    for ( i = 0; i < sv->segment_count; ++i )
+      free( sv->segments[ i ].bits );
+
+    free( sv->segments );
+    sv->segments = NULL;
+  }
+
+  if ( sv->buckets )
+  {
+    free( sv->buckets );
+    sv->buckets = NULL;
+  }
+
+  if ( sv->base )
+  {
+    free( sv->base );
+    sv->base = NULL;
+  }
+
+  pthread_mutex_destroy( &sv->queue_lock );
+  pthread_cond_destroy( &sv->queue_cond );
+  pthread_mutex_destroy( &sv->cache_lock );
+  pthread_cond_destroy( &sv->cache_cond );
+  pthread_rwlock_destroy( &sv->base_lock );
+}
+
+/**
+ * Accepts connections until SIGINT or SIGTERM and polls the idle ones,
+ * queueing a client for the workers once it has sent a request.
+ * Connections are refused while every client slot is taken
+ * @param s
+ */
+void serve_run( struct state * s )
+{
+  struct serve * sv = s->serve_mngr;
+  struct serve_client * c;
+  struct sigaction sa;
+  char buf[ 64 ];
+  int fd, i, n;
+
+  memset( &sa, 0, sizeof( sa ) );
+  sa.sa_handler = serve_signal;
+  sigaction( SIGINT, &sa, NULL );
+  sigaction( SIGTERM, &sa, NULL );
+
+  if ( !s->quiet )
+  {
+    printf( "serving on %s with %d workers\n", s->serve_file,
+            sv->worker_count );
+    fflush( stdout );
+  }
+
+  while ( !serve_stop )
+  {
+    sv->polls[ 0 ].fd = sv->fd;
+    sv->polls[ 1 ].fd = sv->wake[ 0 ];
+
+    /* Clients answered by a worker are left out until they return */
+    pthread_mutex_lock( &sv->queue_lock );
+    for ( i = 0, n = 2; i < SERVE_CLIENTS; ++i )
+    {
+      if ( sv->clients[ i ].fd >= 0 && !sv->clients[ i ].busy )
+      {
+        sv->polled[ n - 2 ] = i;
+        sv->polls[ n++ ].fd = sv->clients[ i ].fd;
+      }
+    }
+    pthread_mutex_unlock( &sv->queue_lock );
+
+    for ( i = 0; i < n; ++i )
+    {
+      sv->polls[ i ].events = POLLIN;
+      sv->polls[ i ].revents = 0;
+    }
+
+    if ( poll( sv->polls, n, SERVE_POLL ) <= 0 )
+      continue;
+
+    if ( sv->polls[ 1 ].revents )
+      while ( read( sv->wake[ 0 ], buf, sizeof( buf ) ) > 0 );
+
+    pthread_mutex_lock( &sv->queue_lock );
+    for ( i = 2; i < n; ++i )
+    {
+      if ( sv->polls[ i ].revents )
+      {
+        c = &sv->clients[ sv->polled[ i - 2 ] ];
+        c->busy = 1;
+        sv->queue[ ( sv->queue_head + sv->queue_size++ ) % SERVE_CLIENTS ] =
+          sv->polled[ i - 2 ];
+        pthread_cond_signal( &sv->queue_cond );
+      }
+    }
+    pthread_mutex_unlock( &sv->queue_lock );
+
+    if ( !sv->polls[ 0 ].revents ||
+         ( fd = accept( sv->fd, NULL, NULL ) ) < 0 )
+      continue;
+
+    pthread_mutex_lock( &sv->queue_lock );
+    for ( i = 0; i < SERVE_CLIENTS && sv->clients[ i ].fd >= 0; ++i );
+    if ( i < SERVE_CLIENTS )
+    {
+      sv->clients[ i ].fd = fd;
+      sv->clients[ i ].busy = 0;
+      sv->clients[ i ].fill = 0;
+      fd = -1;
+    }
+    pthread_mutex_unlock( &sv->queue_lock );
+
+    if ( fd >= 0 )
+      close( fd );
+  }
+}
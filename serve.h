@@ -0,0 +1,147 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdint.h>
+#include <poll.h>
+#include <pthread.h>
+
+/* Size of the bitmap of a cached segment, in bytes */
+#define SERVE_SEGMENT ( 32 << 10 )
+
+/* Default number of cached segments */
+#define SERVE_CACHE 1024
+
+/* Widest range a single range request can list */
+#define SERVE_RANGE_MAX ( 1ull << 24 )
+
+/* Widest range a single count request can cover, 2048 segments */
+#define SERVE_COUNT_MAX ( 1ull << 30 )
+
+/* Connections waiting to be accepted */
+#define SERVE_QUEUE 64
+
+/* Most connections open at once, more are refused */
+#define SERVE_CLIENTS 1024
+
+/* Milliseconds between checks for the end of the daemon */
+#define SERVE_POLL 200
+
+/* Longest request line */
+#define SERVE_LINE 256
+
+struct state;
+
+struct serve_segment
+{
+  /* Segment number, it covers odd indices from id * SERVE_SEGMENT * 8 */
+  uint64_t id;
+
+  /* Bitmap, bit i is set if the odd number is composite */
+  uint8_t * bits;
+
+  /* Number of requests using the segment, it is not evicted while set */
+  int refs;
+
+  /* Cleared while the segment is being sieved */
+  int ready;
+
+  /* Neighbours in the LRU list, most recently used first */
+  struct serve_segment * prev;
+  struct serve_segment * next;
+
+  /* Next segment in the same hash bucket */
+  struct serve_segment * chain;
+};
+
+struct serve_client
+{
+  /* Socket, -1 if the slot is free */
+  int fd;
+
+  /* Set while a worker answers the client, the poller skips it */
+  int busy;
+
+  /* Start of a request line split across reads */
+  char line[ SERVE_LINE ];
+  size_t fill;
+};
+
+struct serve
+{
+  /* Listening Unix socket */
+  int fd;
+
+  /* Cleared to stop the workers */
+  volatile int running;
+
+  /* Workers answering requests */
+  pthread_t * workers;
+  int worker_count;
+
+  /* Open connections, guarded by queue_lock */
+  struct serve_client clients[ SERVE_CLIENTS ];
+
+  /* Clients with a request to read, guarded by queue_lock */
+  int queue[ SERVE_CLIENTS ];
+  int queue_head;
+  int queue_size;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+
+  /* Pipe waking up the poller when a client is idle again */
+  int wake[ 2 ];
+
+  /* Sockets polled by serve_run and the clients they belong to */
+  struct pollfd polls[ SERVE_CLIENTS + 2 ];
+  int polled[ SERVE_CLIENTS ];
+
+  /* Every odd prime below base_limit, grown on demand */
+  uint32_t * base;
+  uint64_t base_count;
+  uint64_t base_capacity;
+  uint64_t base_limit;
+  pthread_rwlock_t base_lock;
+
+  /* Cached segments, guarded by cache_lock */
+  struct serve_segment * segments;
+  int segment_count;
+  int segment_capacity;
+  struct serve_segment ** buckets;
+  int bucket_bits;
+  struct serve_segment * lru_head;
+  struct serve_segment * lru_tail;
+  uint64_t hits;
+  uint64_t misses;
+  pthread_mutex_t cache_lock;
+  pthread_cond_t cache_cond;
+};
+
+void serve_create( struct state * );
+void serve_destroy( struct state * );
+void serve_run( struct state * );
+
+#endif
@@ -0,0 +1,384 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "chunk.h"
+#include "kernel.h"
+#include "smooth.h"
+#include "state.h"
+
+/**
+ * Opens the output and allocates the accumulators
+ * @param s
+ */
+void smooth_create( struct state * s )
+{
+  struct smooth * sm;
+  double end;
+  size_t sz;
+  int i;
+
+  if ( !( sm = s->smooth_mngr ) )
+    return;
+
+  sm->fd = -1;
+  if ( !s->smooth_bound )
+    return;
+
+  if ( ( sm->fd = open( s->smooth_file, O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) < 0 )
+  {
+    state_error( s, "Cannot open %s: %s", s->smooth_file, strerror( errno ) );
+  }
+
+  if ( pthread_mutex_init( &sm->lock, NULL ) )
+  {
+    state_error( s, "Cannot create smooth mutex" );
+  }
+
+  end = (double)s->chunk_count * s->chunk_size * 16;
+  sm->scale = SMOOTH_RANGE / log2( end );
+
+  /* An integer with a cofactor above B passes if the rounding error of
+   * its smooth part, under one unit per factor and log2( end ) factors
+   * at most, is larger than the units of the cofactor. Large bounds
+   * leave no room for that
+   */
+  sm->confirm = sm->scale * log2( (double)s->smooth_bound + 1.0 ) <
+                log2( end ) + 1.0;
+
+  sm->scratch_count = s->thread_count;
+  sz = sizeof( struct smooth_scratch ) * sm->scratch_count;
+  assert( sm->scratch = (struct smooth_scratch*)malloc( sz ) );
+  for ( i = 0; i < sm->scratch_count; ++i )
+  {
+    assert( sm->scratch[ i ].logs = (uint8_t*)malloc( SMOOTH_SEGMENT ) );
+    assert( sm->scratch[ i ].marks = (uint64_t*)malloc( SMOOTH_SEGMENT / 8 ) );
+    assert( sm->scratch[ i ].rests = (uint64_t*)malloc( sizeof( uint64_t ) * SMOOTH_SEGMENT ) );
+  }
+
+  sz = sizeof( struct smooth_chunk ) * ( s->chunk_count + 2 );
+  assert( sm->chunks = (struct smooth_chunk*)malloc( sz ) );
+  memset( sm->chunks, 0, sz );
+  sm->next = 1;
+  sm->offset = 0;
+}
+
+/**
+ * Frees the accumulators and closes the output
+ * @param s
+ */
+void smooth_destroy( struct state * s )
+{
+  struct smooth * sm;
+  int i;
+
+  if ( !( sm = s->smooth_mngr ) || !sm->chunks )
+    return;
+
+  for ( i = 0; i < s->chunk_count + 2; ++i )
+  {
+    if ( sm->chunks[ i ].data )
+      free( sm->chunks[ i ].data );
+  }
+
+  for ( i = 0; i < sm->scratch_count; ++i )
+  {
+    free( sm->scratch[ i ].logs );
+    free( sm->scratch[ i ].marks );
+    free( sm->scratch[ i ].rests );
+  }
+
+  free( sm->scratch );
+  free( sm->chunks );
+  sm->chunks = NULL;
+  pthread_mutex_destroy( &sm->lock );
+
+  if ( sm->fd >= 0 )
+  {
+    close( sm->fd );
+    sm->fd = -1;
+  }
+}
+
+/**
+ * Adds the rounded up log of every prime power up to the bound to
+ * the integers of [lo, lo + len) it divides. The log of a prime only
+ * changes at a few primes, it is recomputed there only
+ * @param s
+ * @param logs
+ * @param lo
+ * @param len
+ */
+static void smooth_sieve( struct state * s, uint8_t * logs,
+                          uint64_t lo, uint64_t len )
+{
+  struct smooth * sm = s->smooth_mngr;
+  struct chunks * c = s->chunk_mngr;
+  uint64_t i, j, p, q, hi, next;
+  uint8_t log;
+
+  memset( logs, 0, len );
+
+  hi = lo + len - 1;
+  log = 0, next = 0;
+  for ( i = 0; i < c->primes_count; ++i )
+  {
+    p = c->primes_data[ i ];
+    if ( p > s->smooth_bound || p > hi )
+      break;
+
+    if ( p >= next )
+    {
+      log = (uint8_t)ceil( sm->scale * log2( (double)p ) );
+      next = (uint64_t)floor( exp2( log / sm->scale ) );
+    }
+
+    for ( q = p; ; q *= p )
+    {
+      j = ( lo + q - 1 ) / q * q;
+      for ( j -= lo; j < len; j += q )
+        logs[ j ] += log;
+
+      if ( q > hi / p )
+        break;
+    }
+  }
+}
+
+/**
+ * Marks the integers of [lo, lo + len) whose logs add up to their own
+ * log. The kernel compares 64 accumulators at once with the lowest
+ * threshold of the block, the hits are then checked one by one
+ * @param s
+ * @param sc
+ * @param lo
+ * @param len
+ * @return Number of marked integers
+ */
+static uint64_t smooth_scan( struct state * s, struct smooth_scratch * sc,
+                             uint64_t lo, uint64_t len )
+{
+  struct smooth * sm = s->smooth_mngr;
+  uint64_t b, mask, n, low, count;
+  int bit;
+
+  memset( sc->marks, 0, len / 8 );
+
+  count = 0;
+  for ( b = 0; b < len; b += 64 )
+  {
+    low = lo + b < 2 ? 2 : lo + b;
+    mask = s->kernel->threshold( sc->logs + b,
+                                 (uint8_t)( sm->scale * log2( (double)low ) ) );
+
+    for ( ; mask; mask &= mask - 1 )
+    {
+      bit = __builtin_ctzll( mask );
+      n = lo + b + bit;
+      if ( n < 2 || sc->logs[ b + bit ] <
+           (uint8_t)( sm->scale * log2( (double)n ) ) )
+        continue;
+
+      sc->marks[ b >> 6 ] |= 1ull << bit;
+      sc->rests[ b + bit ] = n;
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/**
+ * Divides the prime factors up to the bound out of the marked integers
+ * of [lo, lo + len). The rounded logs of many small factors can exceed
+ * the log of a missing cofactor, only a cofactor of 1 is smooth
+ * @param s
+ * @param sc
+ * @param lo
+ * @param len
+ */
+static void smooth_confirm( struct state * s, struct smooth_scratch * sc,
+                            uint64_t lo, uint64_t len )
+{
+  struct chunks * c = s->chunk_mngr;
+  uint64_t i, j, p, hi;
+
+  hi = lo + len - 1;
+  for ( i = 0; i < c->primes_count; ++i )
+  {
+    p = c->primes_data[ i ];
+    if ( p > s->smooth_bound || p > hi )
+      break;
+
+    j = ( lo + p - 1 ) / p * p;
+    for ( j -= lo; j < len; j += p )
+    {
+      if ( !( sc->marks[ j >> 6 ] & ( 1ull << ( j & 63 ) ) ) )
+        continue;
+
+      do
+      {
+        sc->rests[ j ] /= p;
+      } while ( sc->rests[ j ] % p == 0 );
+    }
+  }
+}
+
+/**
+ * Appends the marked integers of [lo, lo + len) left with a cofactor
+ * of 1 if they had to be confirmed, and 1 itself at the start
+ * @param s
+ * @param sc
+ * @param lo
+ * @param len
+ * @param tc Text of the chunk
+ * @param capacity
+ */
+static void smooth_append( struct state * s, struct smooth_scratch * sc,
+                           uint64_t lo, uint64_t len,
+                           struct smooth_chunk * tc, uint64_t * capacity )
+{
+  struct smooth * sm = s->smooth_mngr;
+  uint64_t w, mask, j;
+
+  if ( lo == 0 )
+  {
+    sc->marks[ 0 ] |= 2ull;
+    sc->rests[ 1 ] = 1;
+  }
+
+  for ( w = 0; w < len / 64; ++w )
+  {
+    for ( mask = sc->marks[ w ]; mask; mask &= mask - 1 )
+    {
+      j = ( w << 6 ) + __builtin_ctzll( mask );
+      if ( sm->confirm && sc->rests[ j ] != 1 )
+        continue;
+
+      if ( tc->length + SMOOTH_LINE + 1 > *capacity )
+      {
+        *capacity = *capacity ? *capacity << 1 : 4096;
+        assert( tc->data = (char*)realloc( tc->data, *capacity ) );
+      }
+
+      tc->length += sprintf( tc->data + tc->length, "%llu\n",
+                             (unsigned long long)( lo + j ) );
+    }
+  }
+}
+
+/**
+ * Finds the smooth numbers of a saved chunk, the text waits for
+ * smooth_write
+ * @param s
+ * @param thread Index of the calling thread
+ * @param n      Chunk number
+ */
+void smooth_chunk( struct state * s, int thread, int n )
+{
+  struct smooth * sm;
+  struct smooth_scratch * sc;
+  struct smooth_chunk chunk;
+  uint64_t lo, end, len, capacity;
+
+  if ( !( sm = s->smooth_mngr ) || !sm->chunks )
+    return;
+
+  /* An empty chunk still needs a buffer to be marked as done */
+  capacity = SMOOTH_LINE + 1;
+  chunk.length = 0;
+  assert( chunk.data = (char*)malloc( capacity ) );
+
+  sc = &sm->scratch[ thread ];
+  end = (uint64_t)n * s->chunk_size * 16;
+  for ( lo = end - s->chunk_size * 16; lo < end; lo += len )
+  {
+    len = end - lo < SMOOTH_SEGMENT ? end - lo : SMOOTH_SEGMENT;
+    smooth_sieve( s, sc->logs, lo, len );
+    if ( smooth_scan( s, sc, lo, len ) && sm->confirm )
+      smooth_confirm( s, sc, lo, len );
+    smooth_append( s, sc, lo, len, &chunk, &capacity );
+  }
+
+  pthread_mutex_lock( &sm->lock );
+  sm->chunks[ n ] = chunk;
+  pthread_mutex_unlock( &sm->lock );
+}
+
+/**
+ * Writes every sieved chunk which is next in line. Offsets are handed
+ * out in order under the lock, the writes run outside of it
+ * @param s
+ */
+void smooth_write( struct state * s )
+{
+  struct smooth * sm;
+  struct smooth_chunk * tc;
+  uint64_t offset, off;
+  ssize_t written;
+  int from, to, i;
+
+  if ( !( sm = s->smooth_mngr ) || !sm->chunks )
+    return;
+
+  /* Claim the chunks which can be placed after the last one */
+  pthread_mutex_lock( &sm->lock );
+  from = sm->next;
+  offset = sm->offset;
+  while ( sm->next <= s->chunk_count && sm->chunks[ sm->next ].data )
+  {
+    sm->offset += sm->chunks[ sm->next ].length;
+    sm->next++;
+  }
+  to = sm->next;
+  pthread_mutex_unlock( &sm->lock );
+
+  for ( i = from; i < to; ++i )
+  {
+    tc = &sm->chunks[ i ];
+    for ( off = 0; off < tc->length; off += written )
+    {
+      written = pwrite( sm->fd, tc->data + off, tc->length - off, offset + off );
+      if ( written < 0 && errno == EINTR )
+        written = 0;
+      else if ( written <= 0 )
+      {
+        fprintf( stderr, "Cannot write %s: %s\n", s->smooth_file,
+                 strerror( errno ) );
+        break;
+      }
+    }
+
+    offset += tc->length;
+    free( tc->data );
+    tc->data = NULL;
+  }
+}
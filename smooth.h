@@ -0,0 +1,102 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef SMOOTH_H
+#define SMOOTH_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* Integers sieved at once inside a chunk, a multiple of 64 */
+#define SMOOTH_SEGMENT ( 1 << 16 )
+
+/* The logarithm of the end of the sieve is scaled to this many units.
+ * Logs of primes are rounded up, which adds less than one unit per
+ * prime factor, so 64 factors still fit in a byte. The error lets some
+ * numbers which are not smooth through, they are confirmed exactly
+ */
+#define SMOOTH_RANGE 180
+
+/* Longest line: 20 digits and a newline */
+#define SMOOTH_LINE 21
+
+struct state;
+
+struct smooth_chunk
+{
+  /* Smooth numbers of the chunk as text, NULL until it is sieved */
+  char * data;
+
+  /* Length of the text */
+  uint64_t length;
+};
+
+struct smooth_scratch
+{
+  /* Log accumulators of the segment */
+  uint8_t * logs;
+
+  /* Integers of the segment whose logs pass the threshold */
+  uint64_t * marks;
+
+  /* Cofactors of the marked integers, set for them only */
+  uint64_t * rests;
+};
+
+struct smooth
+{
+  /* File descriptor of the output */
+  int fd;
+
+  /* Units per bit of logarithm */
+  double scale;
+
+  /* Set if the rounding errors can let numbers which are not smooth
+   * through, which then have to be confirmed by division
+   */
+  int confirm;
+
+  /* Scratch of every thread */
+  struct smooth_scratch * scratch;
+  int scratch_count;
+
+  /* Sieved chunks waiting to be written, numbered from 1 */
+  struct smooth_chunk * chunks;
+
+  /* Next chunk to be placed in the file */
+  int next;
+
+  /* Offset of the next chunk in the file */
+  uint64_t offset;
+
+  /* Guards next, offset and the chunks */
+  pthread_mutex_t lock;
+};
+
+void smooth_create( struct state * );
+void smooth_destroy( struct state * );
+void smooth_chunk( struct state *, int thread, int n );
+void smooth_write( struct state * );
+
+#endif
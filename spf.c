@@ -0,0 +1,200 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "spf.h"
+#include "state.h"
+
+/**
+ * Creates the smallest prime factor table
+ * @param s
+ */
+void spf_create( struct state * s )
+{
+  struct spf * f;
+
+  if ( !( f = s->spf_mngr ) || !s->spf_file )
+    return;
+
+  /* One 32 bit entry for every odd number in the sieve */
+  f->count = s->chunk_count * s->chunk_size * 8;
+  f->size = f->count * sizeof( uint32_t );
+  if ( ( f->fd = open( s->spf_file, O_CREAT | O_RDWR | O_TRUNC, 0666 ) ) < 0 )
+  {
+    state_error( s, "Cannot open file '%s'", s->spf_file );
+  }
+
+  if ( ftruncate( f->fd, f->size ) < 0 )
+  {
+    state_error( s, "Cannot resize file '%s'", s->spf_file );
+  }
+
+  if ( ( f->data = mmap( 0, f->size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, f->fd, 0 ) ) == MAP_FAILED )
+  {
+    f->data = NULL;
+    state_error( s, "Cannot mmap file '%s'", s->spf_file );
+  }
+}
+
+/**
+ * Unmaps the table
+ * @param s
+ */
+void spf_destroy( struct state * s )
+{
+  struct spf * f;
+
+  if ( !( f = s->spf_mngr ) )
+    return;
+
+  if ( f->data )
+  {
+    munmap( f->data, f->size );
+    f->data = NULL;
+  }
+
+  if ( f->fd > 0 )
+  {
+    close( f->fd );
+    f->fd = -1;
+  }
+}
+
+/**
+ * Records prime as a factor of its odd multiples in a segment,
+ * following the same layout as jobs_cross_out. Jobs with different
+ * divider chunks may race on the same entry, so the minimum is kept
+ * with a compare and swap
+ * @param s
+ * @param first Index of the first odd number in the segment
+ * @param count Number of odd numbers in the segment
+ * @param prime
+ */
+void spf_cross_out( struct state * s, uint64_t first, uint64_t count,
+                    uint64_t prime )
+{
+  uint32_t * slot, old;
+  uint64_t low, n, i;
+
+  /* Only odd n >= prime^2 can have prime as its smallest factor */
+  if ( prime < 3ull || prime > UINT32_MAX )
+    return;
+
+  low = ( first << 1ull ) + 1ull;
+  if ( ( n = prime * prime ) < low )
+  {
+    n = low + ( prime - low % prime ) % prime;
+    if ( !( n & 1ull ) )
+      n += prime;
+  }
+
+  for ( i = n >> 1ull; i < first + count; i += prime )
+  {
+    slot = &s->spf_mngr->data[ i ];
+    while ( ( old = *slot ) == 0 || old > prime )
+    {
+      if ( __sync_bool_compare_and_swap( slot, old, (uint32_t)prime ) )
+        break;
+    }
+  }
+}
+
+/**
+ * Returns the smallest prime factor of n
+ * @param s
+ * @param n
+ * @return Smallest prime factor, n if n is prime
+ */
+uint64_t spf_get( struct state * s, uint64_t n )
+{
+  struct spf * f;
+  uint32_t p;
+
+  if ( !( f = s->spf_mngr ) || !f->data )
+    return 0ull;
+
+  if ( n < 2ull )
+    return n;
+
+  if ( !( n & 1ull ) )
+    return 2ull;
+
+  if ( ( n >> 1ull ) >= f->count )
+  {
+    state_error( s, "%llu is not covered by the factor table",
+                 (unsigned long long)n );
+  }
+
+  return ( p = f->data[ n >> 1ull ] ) ? p : n;
+}
+
+/**
+ * Factors n by repeatedly dividing with its smallest factor.
+ * Cofactors are always smaller, so they are covered by the table
+ * @param s
+ * @param n
+ * @param factors Receives at most SPF_MAX_FACTORS factors
+ * @return Number of prime factors
+ */
+int spf_factor( struct state * s, uint64_t n, uint64_t * factors )
+{
+  uint64_t p;
+  int count = 0;
+
+  while ( n > 1ull )
+  {
+    p = spf_get( s, n );
+    factors[ count++ ] = p;
+    n /= p;
+  }
+
+  return count;
+}
+
+/**
+ * Prints the factorisation of the number requested with --factor
+ * @param s
+ */
+void spf_print( struct state * s )
+{
+  uint64_t factors[ SPF_MAX_FACTORS ];
+  int i, count;
+
+  if ( !s->spf_mngr || !s->spf_mngr->data || !s->factor )
+    return;
+
+  count = spf_factor( s, s->factor, factors );
+
+  printf( "%llu =", (unsigned long long)s->factor );
+  for ( i = 0; i < count; ++i )
+  {
+    printf( "%s %llu", i ? " *" : "", (unsigned long long)factors[ i ] );
+  }
+  printf( "\n" );
+}
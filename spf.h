@@ -0,0 +1,59 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef SPF_H
+#define SPF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest number of prime factors of a 64 bit integer */
+#define SPF_MAX_FACTORS 64
+
+struct state;
+
+struct spf
+{
+  /* File descriptor of the table */
+  int fd;
+
+  /* Number of odd integers covered by the table */
+  uint64_t count;
+
+  /* Size of the table in bytes */
+  size_t size;
+
+  /* Smallest prime factor of 2i+1 at index i, 0 for primes */
+  uint32_t * data;
+};
+
+void     spf_create( struct state * );
+void     spf_destroy( struct state * );
+void     spf_cross_out( struct state *, uint64_t first, uint64_t count,
+                        uint64_t prime );
+uint64_t spf_get( struct state *, uint64_t n );
+int      spf_factor( struct state *, uint64_t n, uint64_t * factors );
+void     spf_print( struct state * );
+
+#endif
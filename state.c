@@ -30,7 +30,24 @@ THE SOFTWARE.
 #include "state.h"
 #include "thread.h"
 #include "chunk.h"
+#include "gap.h"
 #include "job.h"
+#include "kernel.h"
+#include "lmo.h"
+#include "lookup.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "rank.h"
+#include "spf.h"
+#include "goldbach.h"
+#include "reduce.h"
+#include "serve.h"
+#include "trace.h"
+#include "mult.h"
+#include "smooth.h"
+#include "progression.h"
+#include "text.h"
+#include "window.h"
 
 /**
  * Creates a new state, initialising modules
@@ -38,22 +55,146 @@ THE SOFTWARE.
  */
 void state_create( struct state * state )
 {
+  // Pick the kernels for this CPU
+  kernel_select( state );
+
   // Initialise the chunk manager
   assert( state->chunk_mngr = (struct chunks*)malloc( sizeof( struct chunks ) ) );
   memset( state->chunk_mngr, 0, sizeof( struct chunks ) );
   chunks_create( state );
 
+  // Initialise the rank/select index
+  assert( state->rank_mngr = (struct rank*)malloc( sizeof( struct rank ) ) );
+  memset( state->rank_mngr, 0, sizeof( struct rank ) );
+  rank_create( state );
+
+  // Open the decimal output
+  assert( state->text_mngr = (struct text*)malloc( sizeof( struct text ) ) );
+  memset( state->text_mngr, 0, sizeof( struct text ) );
+  text_create( state );
+
+  // Initialise the gap statistics
+  assert( state->gap_mngr = (struct gaps*)malloc( sizeof( struct gaps ) ) );
+  memset( state->gap_mngr, 0, sizeof( struct gaps ) );
+  gaps_create( state );
+
+  // Initialise the smallest prime factor table
+  assert( state->spf_mngr = (struct spf*)malloc( sizeof( struct spf ) ) );
+  memset( state->spf_mngr, 0, sizeof( struct spf ) );
+  spf_create( state );
+
+  // Parse the reducers
+  assert( state->reduce_mngr = (struct reducers*)malloc( sizeof( struct reducers ) ) );
+  memset( state->reduce_mngr, 0, sizeof( struct reducers ) );
+  reducers_create( state );
+
+  // Initialise the multiplicative function sums
+  assert( state->mult_mngr = (struct mult*)malloc( sizeof( struct mult ) ) );
+  memset( state->mult_mngr, 0, sizeof( struct mult ) );
+  mult_create( state );
+
+  // Open the smooth number output
+  assert( state->smooth_mngr = (struct smooth*)malloc( sizeof( struct smooth ) ) );
+  memset( state->smooth_mngr, 0, sizeof( struct smooth ) );
+  smooth_create( state );
+
+  // Initialise the Goldbach results
+  assert( state->goldbach_mngr = (struct goldbach*)malloc( sizeof( struct goldbach ) ) );
+  memset( state->goldbach_mngr, 0, sizeof( struct goldbach ) );
+  goldbach_create( state );
+
+  // Allocate the rings of the trace
+  assert( state->trace_mngr = (struct trace*)malloc( sizeof( struct trace ) ) );
+  memset( state->trace_mngr, 0, sizeof( struct trace ) );
+  trace_create( state );
+
+  // Start serving the progress counters, without a socket the
+  // workers skip the shared counters altogether
+  if ( state->metrics_file )
+  {
+    assert( state->metrics_mngr = (struct metrics*)malloc( sizeof( struct metrics ) ) );
+    memset( state->metrics_mngr, 0, sizeof( struct metrics ) );
+    metrics_create( state );
+  }
+
   // Initialise the job manager
   assert( state->job_mngr = (struct jobs*)malloc( sizeof( struct jobs ) ) );
   memset( state->job_mngr, 0, sizeof( struct jobs ) );
   jobs_create( state );
 
+  // Start the stages which save the sieved chunks
+  assert( state->pipeline_mngr = (struct pipeline*)malloc( sizeof( struct pipeline ) ) );
+  memset( state->pipeline_mngr, 0, sizeof( struct pipeline ) );
+  pipeline_create( state );
+
   // Initialise the thread manager
   assert( state->thread_mngr = (struct threads*)malloc( sizeof( struct threads ) ) );
   memset( state->thread_mngr, 0, sizeof( struct threads ) );
   threads_create( state );
 }
 
+/**
+ * Opens a sieve file and answers queries from stdin
+ * @param state
+ */
+void state_query( struct state * state )
+{
+  assert( state->lookup_mngr = (struct lookup*)malloc( sizeof( struct lookup ) ) );
+  memset( state->lookup_mngr, 0, sizeof( struct lookup ) );
+  lookup_query( state );
+}
+
+/**
+ * Counts primes up to pi_x without running the sieve
+ * @param state
+ */
+void state_count( struct state * state )
+{
+  assert( state->lmo_mngr = (struct lmo*)malloc( sizeof( struct lmo ) ) );
+  memset( state->lmo_mngr, 0, sizeof( struct lmo ) );
+  lmo_run( state );
+}
+
+/**
+ * Answers requests on a Unix socket until stopped
+ * @param state
+ */
+void state_serve( struct state * state )
+{
+  assert( state->serve_mngr = (struct serve*)malloc( sizeof( struct serve ) ) );
+  memset( state->serve_mngr, 0, sizeof( struct serve ) );
+  serve_create( state );
+  serve_run( state );
+}
+
+/**
+ * Sieves a window above 2^64 without the chunk files
+ * @param state
+ */
+void state_window( struct state * state )
+{
+  kernel_select( state );
+
+  assert( state->window_mngr = (struct window*)malloc( sizeof( struct window ) ) );
+  memset( state->window_mngr, 0, sizeof( struct window ) );
+  window_create( state );
+  window_run( state );
+}
+
+/**
+ * Sieves the primes of a single residue class
+ * @param state
+ */
+void state_progression( struct state * state )
+{
+  kernel_select( state );
+
+  assert( state->progression_mngr = (struct progression*)malloc( sizeof( struct progression ) ) );
+  memset( state->progression_mngr, 0, sizeof( struct progression ) );
+  progression_create( state );
+  progression_run( state );
+}
+
 /**
  * Bails out with an error message
  * @param state
@@ -95,6 +236,19 @@ void state_error( struct state * state, const char * fmt, ... )
 void state_run( struct state * state )
 {
   threads_wait( state );
+  trace_write( state );
+  gaps_write( state );
+  reducers_print( state );
+  mult_write( state );
+  spf_print( state );
+  goldbach_run( state );
+
+  if ( state->check_pi )
+  {
+    assert( state->lmo_mngr = (struct lmo*)malloc( sizeof( struct lmo ) ) );
+    memset( state->lmo_mngr, 0, sizeof( struct lmo ) );
+    lmo_check( state );
+  }
 }
 
 /**
@@ -105,6 +259,13 @@ void state_destroy( struct state * state )
 {
   if ( state )
   {
+    if ( state->pipeline_mngr )
+    {
+      pipeline_destroy( state );
+      free( state->pipeline_mngr );
+      state->pipeline_mngr = NULL;
+    }
+
     if ( state->job_mngr )
     {
       jobs_destroy( state );
@@ -112,6 +273,90 @@ void state_destroy( struct state * state )
       state->job_mngr = NULL;
     }
 
+    if ( state->gap_mngr )
+    {
+      gaps_destroy( state );
+      free( state->gap_mngr );
+      state->gap_mngr = NULL;
+    }
+
+    if ( state->serve_mngr )
+    {
+      serve_destroy( state );
+      free( state->serve_mngr );
+      state->serve_mngr = NULL;
+    }
+
+    if ( state->window_mngr )
+    {
+      window_destroy( state );
+      free( state->window_mngr );
+      state->window_mngr = NULL;
+    }
+
+    if ( state->progression_mngr )
+    {
+      progression_destroy( state );
+      free( state->progression_mngr );
+      state->progression_mngr = NULL;
+    }
+
+    if ( state->lookup_mngr )
+    {
+      lookup_close( state );
+      free( state->lookup_mngr );
+      state->lookup_mngr = NULL;
+    }
+
+    if ( state->lmo_mngr )
+    {
+      lmo_destroy( state );
+      free( state->lmo_mngr );
+      state->lmo_mngr = NULL;
+    }
+
+    if ( state->rank_mngr )
+    {
+      rank_destroy( state );
+      free( state->rank_mngr );
+      state->rank_mngr = NULL;
+    }
+
+    if ( state->reduce_mngr )
+    {
+      reducers_destroy( state );
+      free( state->reduce_mngr );
+      state->reduce_mngr = NULL;
+    }
+
+    if ( state->mult_mngr )
+    {
+      mult_destroy( state );
+      free( state->mult_mngr );
+      state->mult_mngr = NULL;
+    }
+
+    if ( state->smooth_mngr )
+    {
+      smooth_destroy( state );
+      free( state->smooth_mngr );
+      state->smooth_mngr = NULL;
+    }
+
+    if ( state->goldbach_mngr )
+    {
+      goldbach_destroy( state );
+      free( state->goldbach_mngr );
+      state->goldbach_mngr = NULL;
+    }
+
+    if ( state->spf_mngr )
+    {
+      spf_destroy( state );
+      free( state->spf_mngr );
+      state->spf_mngr = NULL;
+    }
+
     if ( state->chunk_mngr )
     {
       chunks_destroy( state );
@@ -126,6 +371,27 @@ void state_destroy( struct state * state )
       state->thread_mngr = NULL;
     }
 
+    if ( state->text_mngr )
+    {
+      text_destroy( state );
+      free( state->text_mngr );
+      state->text_mngr = NULL;
+    }
+
+    if ( state->metrics_mngr )
+    {
+      metrics_destroy( state );
+      free( state->metrics_mngr );
+      state->metrics_mngr = NULL;
+    }
+
+    if ( state->trace_mngr )
+    {
+      trace_destroy( state );
+      free( state->trace_mngr );
+      state->trace_mngr = NULL;
+    }
+
     if ( state->sieve_file )
     {
       free( state->sieve_file );
@@ -137,5 +403,107 @@ void state_destroy( struct state * state )
       free( state->primes_file );
       state->primes_file = NULL;
     }
+
+    if ( state->text_file )
+    {
+      free( state->text_file );
+      state->text_file = NULL;
+    }
+
+    if ( state->gaps_file )
+    {
+      free( state->gaps_file );
+      state->gaps_file = NULL;
+    }
+
+    if ( state->reduce_list )
+    {
+      free( state->reduce_list );
+      state->reduce_list = NULL;
+    }
+
+    if ( state->mult_file )
+    {
+      free( state->mult_file );
+      state->mult_file = NULL;
+    }
+
+    if ( state->mu_file )
+    {
+      free( state->mu_file );
+      state->mu_file = NULL;
+    }
+
+    if ( state->smooth_file )
+    {
+      free( state->smooth_file );
+      state->smooth_file = NULL;
+    }
+
+    if ( state->goldbach_file )
+    {
+      free( state->goldbach_file );
+      state->goldbach_file = NULL;
+    }
+
+    if ( state->spf_file )
+    {
+      free( state->spf_file );
+      state->spf_file = NULL;
+    }
+
+    if ( state->tune_file )
+    {
+      free( state->tune_file );
+      state->tune_file = NULL;
+    }
+
+    if ( state->serve_file )
+    {
+      free( state->serve_file );
+      state->serve_file = NULL;
+    }
+
+    if ( state->window_base )
+    {
+      free( state->window_base );
+      state->window_base = NULL;
+    }
+
+    if ( state->query_file )
+    {
+      free( state->query_file );
+      state->query_file = NULL;
+    }
+
+    if ( state->rank_file )
+    {
+      free( state->rank_file );
+      state->rank_file = NULL;
+    }
+
+    if ( state->kernel_name )
+    {
+      free( state->kernel_name );
+      state->kernel_name = NULL;
+    }
+
+    if ( state->trace_file )
+    {
+      free( state->trace_file );
+      state->trace_file = NULL;
+    }
+
+    if ( state->metrics_file )
+    {
+      free( state->metrics_file );
+      state->metrics_file = NULL;
+    }
+
+    if ( state->pi_x )
+    {
+      free( state->pi_x );
+      state->pi_x = NULL;
+    }
   }
 }
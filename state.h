@@ -32,6 +32,23 @@ THE SOFTWARE.
 struct jobs;
 struct threads;
 struct chunks;
+struct gaps;
+struct spf;
+struct lookup;
+struct rank;
+struct lmo;
+struct metrics;
+struct text;
+struct kernel;
+struct goldbach;
+struct reducers;
+struct serve;
+struct window;
+struct progression;
+struct pipeline;
+struct trace;
+struct mult;
+struct smooth;
 
 struct state
 {
@@ -44,12 +61,120 @@ struct state
   /* Size of a chunk */
   uint64_t chunk_size;
 
+  /* Sieving algorithm, JOBS_ERATOSTHENES or JOBS_ATKIN */
+  int algorithm;
+
+  /* Kernel variant forced by --kernel, NULL picks the best one */
+  char * kernel_name;
+
+  /* Kernels used by the sieve */
+  const struct kernel * kernel;
+
   /* Sieve file name */
   char * sieve_file;
 
   /* Output file name */
   char * primes_file;
 
+  /* Output format, TEXT_BINARY or TEXT_DECIMAL */
+  int format;
+
+  /* Decimal output file name */
+  char * text_file;
+
+  /* Gap statistics file name, NULL if disabled */
+  char * gaps_file;
+
+  /* Comma separated reducers run on every saved chunk, NULL if none */
+  char * reduce_list;
+
+  /* Mertens, totient and Liouville sums file name, NULL if disabled */
+  char * mult_file;
+
+  /* Table of mu(n) file name, NULL if disabled */
+  char * mu_file;
+
+  /* Largest prime factor of the smooth numbers, 0 if disabled */
+  uint64_t smooth_bound;
+
+  /* Smooth numbers file name */
+  char * smooth_file;
+
+  /* Goldbach report file name, NULL if disabled */
+  char * goldbach_file;
+
+  /* Smallest prime factor table file name, NULL if disabled */
+  char * spf_file;
+
+  /* Number to factor with the table after the run */
+  uint64_t factor;
+
+  /* Pick the thread count and chunk size automatically */
+  int autotune;
+
+  /* File storing the result of the calibration */
+  char * tune_file;
+
+  /* Suppresses the progress messages */
+  int quiet;
+
+  /* Number of failed attempts to fetch a job before a worker parks */
+  int spin_count;
+
+  /* First number printed by the iterator */
+  uint64_t iterate_from;
+
+  /* Number of primes printed by the iterator, 0 runs the sieve */
+  uint64_t iterate_count;
+
+  /* Sieve file answering queries from stdin, NULL runs the sieve */
+  char * query_file;
+
+  /* Rank/select index of the sieve, NULL if disabled */
+  char * rank_file;
+
+  /* Number whose primes are counted without a sieve, NULL runs the sieve */
+  char * pi_x;
+
+  /* Checks the sieve against the prime counting function */
+  int check_pi;
+
+  /* Unix socket serving metrics during the run, NULL if disabled */
+  char * metrics_file;
+
+  /* Chrome trace of the workers, NULL if disabled */
+  char * trace_file;
+
+  /* Unix socket of the daemon, NULL runs the sieve */
+  char * serve_file;
+
+  /* Number of segments cached by the daemon */
+  int cache_segments;
+
+  /* Memory available to the run in bytes, 0 reads it from the host */
+  uint64_t memory_limit;
+
+  /* Writes back every saved chunk, set if the files exceed the budget */
+  int flush_saved;
+
+  /* Number of chunks in the job table, 0 uses JOBS_COLUMNS */
+  int job_columns;
+
+  /* Number of encoding stages, 0 runs one for every worker */
+  int encoder_count;
+
+  /* Capacity of the queues between the stages */
+  int queue_size;
+
+  /* Start of a window sieved with 128 bit offsets, NULL runs the sieve */
+  char * window_base;
+
+  /* Modulus of the progression sieved alone, 0 runs the sieve */
+  uint64_t progression_modulus;
+
+  /* Residue of the primes in the progression */
+  uint64_t progression_residue;
+
   /* Job manager */
   struct jobs * job_mngr;
 
@@ -59,6 +184,54 @@ struct state
   /* Chunk manager */
   struct chunks * chunk_mngr;
 
+  /* Gap statistics */
+  struct gaps * gap_mngr;
+
+  /* Smallest prime factor table */
+  struct spf * spf_mngr;
+
+  /* Sieve file opened for queries */
+  struct lookup * lookup_mngr;
+
+  /* Rank/select index built while saving */
+  struct rank * rank_mngr;
+
+  /* Tables of the prime counting function */
+  struct lmo * lmo_mngr;
+
+  /* Progress counters */
+  struct metrics * metrics_mngr;
+
+  /* Decimal output writer */
+  struct text * text_mngr;
+
+  /* Events recorded by the workers */
+  struct trace * trace_mngr;
+
+  /* Daemon answering range queries */
+  struct serve * serve_mngr;
+
+  /* Statistics folded over every saved chunk */
+  struct reducers * reduce_mngr;
+
+  /* Multiplicative functions summed over every chunk */
+  struct mult * mult_mngr;
+
+  /* Smooth numbers found in every chunk */
+  struct smooth * smooth_mngr;
+
+  /* Goldbach results of every chunk */
+  struct goldbach * goldbach_mngr;
+
+  /* Window sieved above 2^64 */
+  struct window * window_mngr;
+
+  /* Single residue class sieved */
+  struct progression * progression_mngr;
+
+  /* Stages extracting, encoding and writing saved chunks */
+  struct pipeline * pipeline_mngr;
+
   /* Error handler */
   jmp_buf err_jump;
 
@@ -69,6 +242,11 @@ struct state
 void state_create( struct state * state );
 void state_error( struct state * state, const char * fmt, ... );
 void state_run( struct state * state );
+void state_query( struct state * state );
+void state_count( struct state * state );
+void state_serve( struct state * state );
+void state_window( struct state * state );
+void state_progression( struct state * state );
 void state_destroy( struct state * state );
 
 #endif
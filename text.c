@@ -0,0 +1,267 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "chunk.h"
+#include "state.h"
+#include "text.h"
+#include "thread.h"
+
+/* "00" to "99", converts two digits at once */
+static const char text_pairs[ 201 ] =
+  "00010203040506070809101112131415161718192021222324"
+  "25262728293031323334353637383940414243444546474849"
+  "50515253545556575859606162636465666768697071727374"
+  "75767778798081828384858687888990919293949596979899";
+
+/**
+ * Opens the text output
+ * @param s
+ */
+void text_create( struct state * s )
+{
+  struct text * t;
+  size_t sz;
+
+  if ( !( t = s->text_mngr ) )
+    return;
+
+  t->fd = -1;
+  if ( s->format != TEXT_DECIMAL )
+    return;
+
+  if ( ( t->fd = open( s->text_file, O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) < 0 )
+  {
+    state_error( s, "Cannot open %s: %s", s->text_file, strerror( errno ) );
+  }
+
+  if ( pthread_mutex_init( &t->lock, NULL ) )
+  {
+    state_error( s, "Cannot create text mutex" );
+  }
+
+  sz = sizeof( struct text_chunk ) * ( s->chunk_count + 2 );
+  assert( t->chunks = (struct text_chunk*)malloc( sz ) );
+  memset( t->chunks, 0, sz );
+  t->next = 1;
+  t->offset = 0;
+}
+
+/**
+ * Closes the text output
+ * @param s
+ */
+void text_destroy( struct state * s )
+{
+  struct text * t;
+  int i;
+
+  if ( !( t = s->text_mngr ) || !t->chunks )
+    return;
+
+  for ( i = 0; i < s->chunk_count + 2; ++i )
+  {
+    if ( t->chunks[ i ].data )
+      free( t->chunks[ i ].data );
+  }
+
+  free( t->chunks );
+  t->chunks = NULL;
+  pthread_mutex_destroy( &t->lock );
+
+  if ( t->fd >= 0 )
+  {
+    close( t->fd );
+    t->fd = -1;
+  }
+}
+
+/**
+ * Writes the decimal digits of a number at the end of a buffer
+ * @param end Points past the last digit
+ * @param n
+ * @return Pointer to the first digit
+ */
+static char * text_digits( char * end, uint64_t n )
+{
+  while ( n >= 100 )
+  {
+    end -= 2;
+    memcpy( end, text_pairs + ( n % 100 ) * 2, 2 );
+    n /= 100;
+  }
+
+  if ( n >= 10 )
+  {
+    end -= 2;
+    memcpy( end, text_pairs + n * 2, 2 );
+  }
+  else
+  {
+    *--end = '0' + (char)n;
+  }
+
+  return end;
+}
+
+/**
+ * Converts the primes of a chunk to text. Neighbouring primes share
+ * most of their digits, so only the first one is converted, the others
+ * are found by adding the gap to the decimal digits of the previous one
+ * @param s
+ * @param first Index of the first prime
+ * @param end   Index past the last prime
+ * @param out
+ * @return Length of the text
+ */
+static uint64_t text_convert( struct state * s, uint64_t first, uint64_t end,
+                              char * out )
+{
+  struct chunks * c = s->chunk_mngr;
+  char digits[ TEXT_LINE ], * start, * p, * o;
+  uint64_t i, prev, prime, gap, len;
+  int v;
+
+  if ( first >= end )
+    return 0;
+
+  o = out;
+  prev = c->primes_data[ first ];
+  start = text_digits( digits + TEXT_LINE, prev );
+  len = digits + TEXT_LINE - start;
+  memcpy( o, start, len );
+  o += len;
+  *o++ = '\n';
+
+  for ( i = first + 1; i < end; ++i )
+  {
+    prime = c->primes_data[ i ];
+    gap = prime - prev;
+    prev = prime;
+
+    /* Add the gap digit by digit, new leading digits start from 0 */
+    for ( p = digits + TEXT_LINE - 1; gap; --p )
+    {
+      if ( p < start )
+        *( start = p ) = '0';
+
+      v = *p - '0' + (int)( gap % 10 );
+      gap /= 10;
+      if ( v >= 10 )
+      {
+        v -= 10;
+        gap++;
+      }
+      *p = '0' + (char)v;
+    }
+
+    len = digits + TEXT_LINE - start;
+    memcpy( o, start, len );
+    o += len;
+    *o++ = '\n';
+  }
+
+  return o - out;
+}
+
+/**
+ * Converts a saved chunk to text, which waits for text_write
+ * @param s
+ * @param n
+ */
+void text_encode( struct state * s, int n )
+{
+  struct text * t;
+  struct chunks * c;
+  uint64_t first, end;
+  char * data;
+
+  if ( !( t = s->text_mngr ) || !t->chunks || !( c = s->chunk_mngr ) )
+    return;
+
+  first = c->primes_index[ n ];
+  end = c->primes_index[ n + 1 ];
+  assert( data = (char*)malloc( ( end - first ) * TEXT_LINE + 1 ) );
+  t->chunks[ n ].length = text_convert( s, first, end, data );
+
+  pthread_mutex_lock( &t->lock );
+  t->chunks[ n ].data = data;
+  pthread_mutex_unlock( &t->lock );
+}
+
+/**
+ * Writes every converted chunk which is next in line. Offsets are
+ * handed out in order under the lock, the writes run outside of it
+ * @param s
+ */
+void text_write( struct state * s )
+{
+  struct text * t;
+  struct text_chunk * tc;
+  uint64_t offset, off;
+  ssize_t written;
+  int from, to, i;
+
+  if ( !( t = s->text_mngr ) || !t->chunks )
+    return;
+
+  /* Claim the chunks which can be placed after the last one */
+  pthread_mutex_lock( &t->lock );
+  from = t->next;
+  offset = t->offset;
+  while ( t->next <= s->chunk_count && t->chunks[ t->next ].data )
+  {
+    t->offset += t->chunks[ t->next ].length;
+    t->next++;
+  }
+  to = t->next;
+  pthread_mutex_unlock( &t->lock );
+
+  for ( i = from; i < to; ++i )
+  {
+    tc = &t->chunks[ i ];
+    for ( off = 0; off < tc->length; off += written )
+    {
+      written = pwrite( t->fd, tc->data + off, tc->length - off, offset + off );
+      if ( written < 0 && errno == EINTR )
+        written = 0;
+      else if ( written <= 0 )
+      {
+        fprintf( stderr, "Cannot write %s: %s\n", s->text_file,
+                 strerror( errno ) );
+        break;
+      }
+    }
+
+    offset += tc->length;
+    free( tc->data );
+    tc->data = NULL;
+  }
+}
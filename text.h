@@ -0,0 +1,72 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* Output formats */
+#define TEXT_BINARY 0
+#define TEXT_DECIMAL 1
+
+/* Longest line: 20 digits and a newline */
+#define TEXT_LINE 21
+
+struct state;
+
+struct text_chunk
+{
+  /* Decimal text of the chunk, NULL until it is converted */
+  char * data;
+
+  /* Length of the text */
+  uint64_t length;
+};
+
+struct text
+{
+  /* File descriptor of the text output */
+  int fd;
+
+  /* Converted chunks waiting to be written, numbered from 1 */
+  struct text_chunk * chunks;
+
+  /* Next chunk to be placed in the file */
+  int next;
+
+  /* Offset of the next chunk in the file */
+  uint64_t offset;
+
+  /* Guards next, offset and the chunks */
+  pthread_mutex_t lock;
+};
+
+void text_create( struct state * );
+void text_destroy( struct state * );
+void text_encode( struct state *, int n );
+void text_write( struct state * );
+
+#endif
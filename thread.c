@@ -28,55 +28,77 @@ THE SOFTWARE.
 #include <string.h>
 #include "state.h"
 #include "job.h"
+#include "metrics.h"
+#include "pipeline.h"
 #include "thread.h"
+#include "trace.h"
 
 /**
  * Thread function
- * @param sp State pointer
+ * @param wp Worker pointer
  */
-void * thread_func( void * sp )
+void * thread_func( void * wp )
 {
   struct job job;
   struct state * s;
   struct threads * t;
-  int has_next, must_save;
+  struct worker * w;
+  int has_next, must_save, idle;
+  uint64_t start;
 
-  if ( !( s = (struct state*)sp ) || !( t = s->thread_mngr ) )
+  if ( !( w = (struct worker*)wp ) || !( s = w->state ) ||
+       !( t = s->thread_mngr ) )
     pthread_exit( NULL );
 
-  has_next = 0, must_save = 0;
+  has_next = 0, must_save = 0, idle = 0;
   while ( t->running )
   {
+    start = trace_now( s );
     pthread_mutex_lock( &t->queue_lock );
+    trace_event( s, w->id, TRACE_QUEUE_WAIT, start, 0, 0 );
 
-    // must_save will be one if a chunk must be saved
-    // if jobs_finish will receive 1 for must_save,
-    // it will know that it can execute stuff which
-    // needs to be after a chunk is saved
+    // must_save will be one if the chunk of the job is sieved
+    // and next in line, it is handed to the extraction stage,
+    // which saves it and releases the jobs depending on it
     if ( has_next )
     {
       jobs_finish( s, &job, &must_save );
     }
 
-    // If the last processed chunk must be saved,
-    // we lock on c->data_primes and save it
     if ( must_save )
     {
-      pthread_mutex_unlock( &t->queue_lock );
-
-      pthread_mutex_lock( &t->save_lock );
-      jobs_save_finished( s, job.filtered_chunk);
-      pthread_mutex_unlock( &t->save_lock );
+      pipeline_save( s, job.filtered_chunk );
+      must_save = 0;
     }
 
-    // Otherwise, we process a new chunk
-    else
+    has_next = jobs_next( s, &job );
+
+    // If every job is blocked, retry a few times then sleep
+    // until jobs_finish makes new work available
+    if ( has_next )
     {
-      has_next = jobs_next( s, &job );
-      pthread_mutex_unlock( &t->queue_lock );
+      idle = 0;
+    }
+    else if ( ++idle > s->spin_count && t->running )
+    {
+      idle = 0;
+      t->parks++;
+      start = trace_now( s );
+      pthread_cond_wait( &t->work_cond, &t->queue_lock );
+      trace_event( s, w->id, TRACE_PARK, start, 0, 0 );
+      t->wakeups++;
+    }
 
-      if ( has_next )
-        jobs_run( s, &job );
+    pthread_mutex_unlock( &t->queue_lock );
+
+    if ( has_next )
+    {
+      metrics_job( s, 1 );
+      start = trace_now( s );
+      jobs_run( s, &job );
+      trace_event( s, w->id, TRACE_JOB, start, job.divider_chunk,
+                   job.filtered_chunk );
+      metrics_job( s, 0 );
     }
   }
 
@@ -112,16 +134,10 @@ void threads_create( struct state * s )
     state_error( s, "Cannot create exit mutex" );
   }
 
-  // Initialse the mutex which will guard the data_primes array
-  if ( pthread_mutex_init( &t->save_lock, NULL ) )
-  {
-    state_error( s, "Cannot create save mutex" );
-  }
-
-  // Initialise the mutex which will guard the output array
-  if ( pthread_rwlock_init( &t->write_lock, NULL ) )
+  // Initialise the cond variable on which idle workers park
+  if ( pthread_cond_init( &t->work_cond, NULL) )
   {
-    state_error( s, "Cannot create write mutex" );
+    state_error( s, "Cannot create work signal" );
   }
 
   // Initialise the cond variable which will signal
@@ -136,6 +152,10 @@ void threads_create( struct state * s )
   assert( t->threads = (pthread_t*)malloc( sz ) );
   memset( t->threads, 0, sz );
 
+  sz = sizeof( struct worker ) * s->thread_count;
+  assert( t->workers = (struct worker*)malloc( sz ) );
+  memset( t->workers, 0, sz );
+
   // Create joinable threads with 2Mb stack
   pthread_attr_init( &attr );
   pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE );
@@ -143,7 +163,10 @@ void threads_create( struct state * s )
 
   for ( i = 0; i < s->thread_count; ++i )
   {
-    if ( pthread_create( &t->threads[ i ], &attr, thread_func, s ) )
+    t->workers[ i ].state = s;
+    t->workers[ i ].id = i;
+    if ( pthread_create( &t->threads[ i ], &attr, thread_func,
+                         &t->workers[ i ] ) )
       state_error( s, "Cannot create thread #%d", i );
   }
 
@@ -151,10 +174,10 @@ void threads_create( struct state * s )
 }
 
 /**
- * Cleanup
+ * Stops the workers and waits for them to exit
  * @param s
  */
-void threads_destroy( struct state * s )
+void threads_join( struct state * s )
 {
   struct threads * t;
   int i;
@@ -164,6 +187,11 @@ void threads_destroy( struct state * s )
 
   t->running = 0;
 
+  // Parked workers must notice that they should exit
+  pthread_mutex_lock( &t->queue_lock );
+  pthread_cond_broadcast( &t->work_cond );
+  pthread_mutex_unlock( &t->queue_lock );
+
   if ( t->threads )
   {
     for ( i = 0; i < s->thread_count; ++i )
@@ -176,16 +204,38 @@ void threads_destroy( struct state * s )
         t->threads[ i ] = 0;
       }
     }
+  }
+}
+
+/**
+ * Cleanup
+ * @param s
+ */
+void threads_destroy( struct state * s )
+{
+  struct threads * t;
 
+  if ( !( t = s->thread_mngr ) )
+    return;
+
+  threads_join( s );
+
+  if ( t->threads )
+  {
     free( t->threads );
     t->threads = NULL;
   }
 
+  if ( t->workers )
+  {
+    free( t->workers );
+    t->workers = NULL;
+  }
+
   pthread_mutex_destroy( &t->queue_lock );
   pthread_mutex_destroy( &t->exit_lock );
-  pthread_mutex_destroy( &t->save_lock );
-  pthread_rwlock_destroy( &t->write_lock );
   pthread_cond_destroy( &t->exit_cond );
+  pthread_cond_destroy( &t->work_cond );
 }
 
 /**
@@ -206,6 +256,31 @@ void threads_wait( struct state * s )
     pthread_cond_wait( &t->exit_cond, &t->exit_lock );
 
   pthread_mutex_unlock( &t->exit_lock );
+
+  // The stages might still be encoding and writing the last chunks
+  threads_join( s );
+  pipeline_drain( s );
+
+  if ( !s->quiet )
+  {
+    printf( "parked %llu times, woken up %llu times by %llu signals\n",
+            t->parks, t->wakeups, t->signals );
+  }
+}
+
+/**
+ * Wakes up the parked workers, the queue lock must be held
+ * @param s
+ */
+void threads_wake( struct state * s )
+{
+  struct threads * t;
+
+  if ( !( t = s->thread_mngr ) )
+    return;
+
+  t->signals++;
+  pthread_cond_broadcast( &t->work_cond );
 }
 
 /**
@@ -226,3 +301,77 @@ void threads_finish( struct state * s )
 
   pthread_mutex_unlock( &t->exit_lock);
 }
+
+/**
+ * Takes items from a map until none are left
+ * @param mp Map pointer
+ */
+void * thread_map_func( void * mp )
+{
+  struct map * m = (struct map*)mp;
+  int i;
+
+  while ( ( i = __sync_fetch_and_add( &m->next, 1 ) ) < m->count )
+  {
+    m->func( m->items + i * m->size );
+  }
+
+  pthread_exit( NULL );
+}
+
+/**
+ * Calls a function on every item of an array on the calling thread
+ * and at most thread_count - 1 others, waiting until all are processed
+ * @param s
+ * @param items Array of items
+ * @param size  Size of an item
+ * @param count Number of items
+ * @param func  Function called with a pointer to each item
+ */
+void threads_map( struct state * s, void * items, size_t size, int count,
+                  void ( * func )( void * ) )
+{
+  struct map m;
+  pthread_t * threads;
+  pthread_attr_t attr;
+  int i, n;
+
+  if ( count < 1 )
+    return;
+
+  m.items = (char*)items;
+  m.size = size;
+  m.count = count;
+  m.next = 0;
+  m.func = func;
+
+  n = s->thread_count < count ? s->thread_count : count;
+  assert( threads = (pthread_t*)malloc( sizeof( pthread_t ) * n ) );
+  n--;
+
+  pthread_attr_init( &attr );
+  pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE );
+  pthread_attr_setstacksize( &attr, 2 << 20 );
+
+  for ( i = 0; i < n; ++i )
+  {
+    if ( pthread_create( &threads[ i ], &attr, thread_map_func, &m ) )
+    {
+      n = i;
+      break;
+    }
+  }
+
+  pthread_attr_destroy( &attr );
+
+  // The caller takes items as well, and all of them if no thread started
+  while ( ( i = __sync_fetch_and_add( &m.next, 1 ) ) < m.count )
+  {
+    m.func( m.items + i * m.size );
+  }
+
+  for ( i = 0; i < n; ++i )
+    pthread_join( threads[ i ], NULL );
+
+  free( threads );
+}
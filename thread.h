@@ -29,14 +29,48 @@ THE SOFTWARE.
 
 struct state;
 
+struct worker
+{
+  /* State shared by all workers */
+  struct state * state;
+
+  /* Index of the worker, used to address per-thread data */
+  int id;
+};
+
+struct map
+{
+  /* Items processed by the threads */
+  char * items;
+
+  /* Size of an item */
+  size_t size;
+
+  /* Number of items */
+  int count;
+
+  /* Index of the next item to process, taken atomically */
+  volatile int next;
+
+  /* Function called on every item */
+  void ( * func )( void * );
+};
+
 struct threads
 {
   pthread_t * threads;
+  struct worker * workers;
   pthread_mutex_t queue_lock;
   pthread_mutex_t exit_lock;
-  pthread_mutex_t save_lock;
-  pthread_rwlock_t write_lock;
   pthread_cond_t exit_cond;
+  pthread_cond_t work_cond;
+
+  /* Number of times workers went to sleep, were woken up and
+   * the work signal was sent, guarded by queue_lock
+   */
+  unsigned long long parks;
+  unsigned long long wakeups;
+  unsigned long long signals;
 
   volatile char running;
   volatile char finished;
@@ -45,6 +79,10 @@ struct threads
 void threads_create( struct state * );
 void threads_destroy( struct state * );
 void threads_wait( struct state * );
+void threads_join( struct state * );
 void threads_finish( struct state * );
+void threads_wake( struct state * );
+void threads_map( struct state *, void * items, size_t size, int count,
+                  void ( * func )( void * ) );
 
 #endif
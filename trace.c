@@ -0,0 +1,205 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "state.h"
+#include "pipeline.h"
+#include "trace.h"
+
+/* Names of the events in the viewer */
+static const char * trace_names[ ] =
+{
+  "job", "queue_lock", "park", "save", "analyse"
+};
+
+/**
+ * Reads the monotonic clock
+ * @return Nanoseconds
+ */
+static uint64_t trace_clock( void )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/**
+ * Allocates a ring for every worker and pipeline stage
+ * @param s
+ */
+void trace_create( struct state * s )
+{
+  struct trace * t;
+  size_t sz;
+  int i;
+
+  if ( !( t = s->trace_mngr ) || !s->trace_file )
+    return;
+
+  t->ring_count = s->thread_count + 1 + pipeline_encoders( s );
+  sz = sizeof( struct trace_ring ) * t->ring_count;
+  assert( t->rings = (struct trace_ring*)malloc( sz ) );
+  memset( t->rings, 0, sz );
+
+  for ( i = 0; i < t->ring_count; ++i )
+  {
+    sz = sizeof( struct trace_event ) * TRACE_EVENTS;
+    assert( t->rings[ i ].events = (struct trace_event*)malloc( sz ) );
+  }
+
+  t->origin = trace_clock( );
+}
+
+/**
+ * Frees the rings
+ * @param s
+ */
+void trace_destroy( struct state * s )
+{
+  struct trace * t;
+  int i;
+
+  if ( !( t = s->trace_mngr ) || !t->rings )
+    return;
+
+  for ( i = 0; i < t->ring_count; ++i )
+  {
+    free( t->rings[ i ].events );
+  }
+
+  free( t->rings );
+  t->rings = NULL;
+}
+
+/**
+ * Returns the time used to start an event
+ * @param s
+ * @return Nanoseconds since the start, 0 if tracing is disabled
+ */
+uint64_t trace_now( struct state * s )
+{
+  if ( !s->trace_mngr || !s->trace_mngr->rings )
+    return 0ull;
+
+  return trace_clock( ) - s->trace_mngr->origin;
+}
+
+/**
+ * Records an event which ends now. Lock waits which did not block
+ * are dropped so that spinning workers do not flood the rings
+ * @param s
+ * @param thread Index of the calling thread
+ * @param type
+ * @param start  Value of trace_now when the event started
+ * @param a
+ * @param b
+ */
+void trace_event( struct state * s, int thread, int type, uint64_t start,
+                  int a, int b )
+{
+  struct trace_ring * r;
+  struct trace_event * e;
+  uint64_t end;
+
+  if ( !s->trace_mngr || !s->trace_mngr->rings )
+    return;
+
+  end = trace_clock( ) - s->trace_mngr->origin;
+  if ( type == TRACE_QUEUE_WAIT && end - start < TRACE_MIN_WAIT )
+    return;
+
+  r = &s->trace_mngr->rings[ thread ];
+  e = &r->events[ r->count++ & ( TRACE_EVENTS - 1 ) ];
+  e->start = start;
+  e->end = end;
+  e->type = type;
+  e->a = a;
+  e->b = b;
+}
+
+/**
+ * Writes the events in the Chrome trace format, which can be
+ * opened in chrome://tracing or Perfetto
+ * @param s
+ */
+void trace_write( struct state * s )
+{
+  struct trace * t;
+  struct trace_ring * r;
+  struct trace_event * e;
+  uint64_t i, first;
+  const char * sep;
+  char name[ 32 ];
+  FILE * f;
+  int n;
+
+  if ( !( t = s->trace_mngr ) || !t->rings )
+    return;
+
+  if ( !( f = fopen( s->trace_file, "w" ) ) )
+  {
+    state_error( s, "Cannot open trace '%s'", s->trace_file );
+  }
+
+  fprintf( f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" );
+  sep = "";
+  for ( n = 0; n < t->ring_count; ++n )
+  {
+    if ( n < s->thread_count )
+      snprintf( name, sizeof( name ), "worker %d", n );
+    else if ( n == s->thread_count )
+      snprintf( name, sizeof( name ), "extract" );
+    else
+      snprintf( name, sizeof( name ), "encode %d", n - s->thread_count - 1 );
+
+    fprintf( f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+             "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", sep, n, name );
+    sep = ",\n";
+
+    r = &t->rings[ n ];
+    first = r->count > TRACE_EVENTS ? r->count - TRACE_EVENTS : 0ull;
+    for ( i = first; i < r->count; ++i )
+    {
+      e = &r->events[ i & ( TRACE_EVENTS - 1 ) ];
+      fprintf( f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+               "\"ts\":%.3f,\"dur\":%.3f", sep, trace_names[ e->type ], n,
+               e->start / 1e3, ( e->end - e->start ) / 1e3 );
+
+      if ( e->type == TRACE_JOB )
+        fprintf( f, ",\"args\":{\"divider\":%d,\"filtered\":%d}", e->a, e->b );
+      else if ( e->type == TRACE_SAVE || e->type == TRACE_ANALYSE )
+        fprintf( f, ",\"args\":{\"chunk\":%d}", e->a );
+
+      fputc( '}', f );
+    }
+  }
+
+  fprintf( f, "\n]}\n" );
+  fclose( f );
+}
@@ -0,0 +1,85 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Events kept per thread, older ones are overwritten, a power of 2 */
+#define TRACE_EVENTS ( 1 << 16 )
+
+/* Lock waits shorter than this many nanoseconds are not recorded */
+#define TRACE_MIN_WAIT 1000
+
+/* Kinds of events */
+#define TRACE_JOB        0
+#define TRACE_QUEUE_WAIT 1
+#define TRACE_PARK       2
+#define TRACE_SAVE       3
+#define TRACE_ANALYSE    4
+
+struct state;
+
+struct trace_event
+{
+  /* Nanoseconds since the start of the run */
+  uint64_t start;
+  uint64_t end;
+
+  /* One of TRACE_JOB .. TRACE_ANALYSE */
+  int type;
+
+  /* Divider and filtered chunk of jobs, chunk number of saves */
+  int a;
+  int b;
+};
+
+struct trace_ring
+{
+  /* Last TRACE_EVENTS events of a thread */
+  struct trace_event * events;
+
+  /* Number of events recorded, including overwritten ones */
+  uint64_t count;
+};
+
+struct trace
+{
+  /* Ring of every worker, written by its owner only */
+  struct trace_ring * rings;
+  int ring_count;
+
+  /* Monotonic time of the start of the run, in nanoseconds */
+  uint64_t origin;
+};
+
+void     trace_create( struct state * );
+void     trace_destroy( struct state * );
+uint64_t trace_now( struct state * );
+void     trace_event( struct state *, int thread, int type, uint64_t start,
+                      int a, int b );
+void     trace_write( struct state * );
+
+#endif
@@ -0,0 +1,296 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "state.h"
+#include "tune.h"
+
+/**
+ * Reads the cache of a given level from sysfs
+ * @param level Cache level
+ * @return Size in bytes, 0 if not found
+ */
+static uint64_t tune_cache( int level )
+{
+  char path[ 128 ], type[ 32 ], size[ 32 ];
+  FILE * f;
+  int i, l;
+  uint64_t bytes;
+
+  for ( i = 0; i < 8; ++i )
+  {
+    snprintf( path, sizeof( path ),
+              "/sys/devices/system/cpu/cpu0/cache/index%d/level", i );
+    if ( !( f = fopen( path, "r" ) ) )
+      break;
+    l = fscanf( f, "%d", &l ) == 1 ? l : -1;
+    fclose( f );
+
+    if ( l != level )
+      continue;
+
+    snprintf( path, sizeof( path ),
+              "/sys/devices/system/cpu/cpu0/cache/index%d/type", i );
+    if ( !( f = fopen( path, "r" ) ) )
+      continue;
+    *type = '\0';
+    if ( fscanf( f, "%31s", type ) != 1 )
+      *type = '\0';
+    fclose( f );
+
+    /* Skip instruction caches */
+    if ( !strcmp( type, "Instruction" ) )
+      continue;
+
+    snprintf( path, sizeof( path ),
+              "/sys/devices/system/cpu/cpu0/cache/index%d/size", i );
+    if ( !( f = fopen( path, "r" ) ) )
+      continue;
+    *size = '\0';
+    if ( fscanf( f, "%31s", size ) != 1 )
+      *size = '\0';
+    fclose( f );
+
+    bytes = strtoull( size, NULL, 10 );
+    switch ( size[ strspn( size, "0123456789" ) ] )
+    {
+      case 'K': bytes <<= 10; break;
+      case 'M': bytes <<= 20; break;
+      case 'G': bytes <<= 30; break;
+    }
+
+    return bytes;
+  }
+
+  return 0ull;
+}
+
+/**
+ * Detects the number of processors and the cache sizes
+ * @param h
+ */
+void tune_host( struct host * h )
+{
+  long n;
+
+  memset( h, 0, sizeof( *h ) );
+
+  h->cpus = ( n = sysconf( _SC_NPROCESSORS_ONLN ) ) > 0 ? (int)n : 1;
+
+  if ( !( h->l1 = tune_cache( 1 ) ) &&
+       ( n = sysconf( _SC_LEVEL1_DCACHE_SIZE ) ) > 0 )
+    h->l1 = n;
+
+  if ( !( h->l2 = tune_cache( 2 ) ) &&
+       ( n = sysconf( _SC_LEVEL2_CACHE_SIZE ) ) > 0 )
+    h->l2 = n;
+
+  if ( !( h->l3 = tune_cache( 3 ) ) &&
+       ( n = sysconf( _SC_LEVEL3_CACHE_SIZE ) ) > 0 )
+    h->l3 = n;
+
+  /* Something sensible if sysfs is not available */
+  if ( !h->l1 )
+    h->l1 = 32ull << 10;
+  if ( !h->l2 )
+    h->l2 = h->l1 << 3;
+}
+
+/**
+ * Loads a previous calibration if it was made on the same host
+ * @param s
+ * @param h
+ * @return 1 if the configuration was loaded
+ */
+static int tune_load( struct state * s, struct host * h )
+{
+  struct host saved;
+  unsigned long long l1, l2, l3, size;
+  int threads;
+  FILE * f;
+  int n;
+
+  if ( !( f = fopen( s->tune_file, "r" ) ) )
+    return 0;
+
+  n = fscanf( f, "cpus %d\nl1 %llu\nl2 %llu\nl3 %llu\nthreads %d\nsize %llu\n",
+              &saved.cpus, &l1, &l2, &l3, &threads, &size );
+  fclose( f );
+
+  if ( n != 6 || saved.cpus != h->cpus || l1 != h->l1 ||
+       l2 != h->l2 || l3 != h->l3 || threads < 1 || size < 64 ||
+       size & 63 )
+    return 0;
+
+  s->thread_count = threads;
+  s->chunk_size = size;
+  return 1;
+}
+
+/**
+ * Saves the chosen configuration
+ * @param s
+ * @param h
+ */
+static void tune_save( struct state * s, struct host * h )
+{
+  FILE * f;
+
+  if ( !( f = fopen( s->tune_file, "w" ) ) )
+  {
+    state_error( s, "Cannot open file '%s'", s->tune_file );
+  }
+
+  fprintf( f, "cpus %d\nl1 %llu\nl2 %llu\nl3 %llu\nthreads %d\nsize %llu\n",
+           h->cpus, (unsigned long long)h->l1, (unsigned long long)h->l2,
+           (unsigned long long)h->l3, s->thread_count,
+           (unsigned long long)s->chunk_size );
+  fclose( f );
+}
+
+/**
+ * Runs a short sieve with a candidate configuration
+ * @param s       Configuration being tuned
+ * @param threads Thread count to try
+ * @param size    Chunk size to try
+ * @return Run time in seconds
+ */
+static double tune_measure( struct state * s, int threads, uint64_t size )
+{
+  struct state tmp;
+  struct timespec start, end;
+  size_t len;
+  char * msg;
+
+  memset( &tmp, 0, sizeof( tmp ) );
+  tmp.thread_count = threads;
+  tmp.chunk_size = size;
+  tmp.chunk_count = (int)( ( TUNE_RANGE >> 3 ) / size );
+  tmp.quiet = 1;
+  tmp.spin_count = s->spin_count;
+
+  /* Scratch files next to the real ones */
+  len = strlen( s->sieve_file ) + 6;
+  assert( tmp.sieve_file = (char*)malloc( len ) );
+  snprintf( tmp.sieve_file, len, "%s.tune", s->sieve_file );
+
+  len = strlen( s->primes_file ) + 6;
+  assert( tmp.primes_file = (char*)malloc( len ) );
+  snprintf( tmp.primes_file, len, "%s.tune", s->primes_file );
+
+  if ( setjmp( tmp.err_jump ) )
+  {
+    msg = tmp.err_msg;
+    tmp.err_msg = NULL;
+    state_destroy( &tmp );
+    state_error( s, "Calibration failed: %s", msg ? msg : "unknown error" );
+  }
+
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  state_create( &tmp );
+  state_run( &tmp );
+  clock_gettime( CLOCK_MONOTONIC, &end );
+
+  unlink( tmp.sieve_file );
+  unlink( tmp.primes_file );
+  state_destroy( &tmp );
+
+  return ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+/**
+ * Picks the thread count and chunk size, either from the tune
+ * file or by timing a few candidates derived from the caches.
+ * The range covered by the sieve is kept the same
+ * @param s
+ */
+void tune_run( struct state * s )
+{
+  struct host h;
+  uint64_t range, sizes[ 4 ], size, best_size;
+  int threads[ 2 ], i, k, best_threads;
+  double t, best;
+
+  range = s->chunk_count * s->chunk_size;
+  tune_host( &h );
+
+  if ( !tune_load( s, &h ) )
+  {
+    /* Chunks fitting the caches, rounded down to cache lines */
+    sizes[ 0 ] = h.l1;
+    sizes[ 1 ] = h.l2 >> 1;
+    sizes[ 2 ] = h.l2;
+    sizes[ 3 ] = h.l3 ? h.l3 / h.cpus : h.l2 << 1;
+
+    threads[ 0 ] = h.cpus > 1 ? h.cpus >> 1 : 1;
+    threads[ 1 ] = h.cpus;
+
+    best = -1.0, best_size = s->chunk_size, best_threads = s->thread_count;
+    for ( i = 0; i < 4; ++i )
+    {
+      size = sizes[ i ] & ~63ull;
+      if ( size < 64 || size > ( TUNE_RANGE >> 4 ) )
+        continue;
+
+      for ( k = 0; k < 2; ++k )
+      {
+        if ( k && threads[ k ] == threads[ k - 1 ] )
+          continue;
+
+        t = tune_measure( s, threads[ k ], size );
+        fprintf( stderr, "tune: %2d threads, %8llu byte chunks: %.3fs\n",
+                 threads[ k ], (unsigned long long)size, t );
+
+        if ( best < 0.0 || t < best )
+        {
+          best = t;
+          best_size = size;
+          best_threads = threads[ k ];
+        }
+      }
+    }
+
+    s->thread_count = best_threads;
+    s->chunk_size = best_size;
+    tune_save( s, &h );
+  }
+
+  /* Small ranges still need a few chunks to keep the threads busy */
+  if ( s->chunk_size > range >> 1 )
+  {
+    s->chunk_size = ( range >> 1 ) & ~63ull;
+    if ( s->chunk_size < 64 )
+      s->chunk_size = 64;
+  }
+
+  s->chunk_count = (int)( ( range + s->chunk_size - 1 ) / s->chunk_size );
+  fprintf( stderr, "tune: using %d threads, %llu byte chunks, %d chunks\n",
+           s->thread_count, (unsigned long long)s->chunk_size,
+           s->chunk_count );
+}
@@ -0,0 +1,53 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stdint.h>
+
+/* Number of odd integers sieved by a calibration run */
+#define TUNE_RANGE ( 1ull << 25 )
+
+struct state;
+
+struct host
+{
+  /* Number of online processors */
+  int cpus;
+
+  /* Size of the L1 data cache in bytes */
+  uint64_t l1;
+
+  /* Size of the L2 cache in bytes */
+  uint64_t l2;
+
+  /* Size of the L3 cache in bytes */
+  uint64_t l3;
+};
+
+void tune_host( struct host * );
+void tune_run( struct state * );
+
+#endif
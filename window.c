@@ -0,0 +1,290 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "iterator.h"
+#include "kernel.h"
+#include "plan.h"
+#include "state.h"
+#include "thread.h"
+#include "window.h"
+
+/**
+ * Estimates the work of sieving the window with the primes up to x:
+ * the crossed out bits grow as ln ln x, while every prime also pays
+ * for a 128 bit remainder to find its first multiple
+ * @param count Bits in the window
+ * @param x
+ */
+static double window_cost( uint64_t count, double x )
+{
+  if ( x < 3.0 )
+    return 0.0;
+
+  return count * log( log( x ) ) + WINDOW_PRIME_COST * x / log( x ) -
+         count * log( log( 3.0 ) );
+}
+
+/**
+ * Crosses out the multiples of the sieving primes of a part
+ * @param wp
+ */
+static void window_sieve( void * wp )
+{
+  struct window_part * part;
+  struct primes_iterator it;
+  struct window * w;
+  uint8_t * bits;
+  uint64_t p, k, count, rem;
+  lmo_uint first, low;
+
+  part = (struct window_part*)wp;
+  w = part->state->window_mngr;
+  bits = part->bits;
+  count = w->count;
+  low = w->base + 1;
+
+  if ( !primes_iterator_init( &it, part->from ) )
+    state_error( part->state, "Cannot create iterator" );
+
+  while ( ( p = primes_iterator_next( &it ) ) && p < part->to )
+  {
+    if ( p == 2 )
+      continue;
+
+    /* The only 128 bit operations, once per prime */
+    rem = (uint64_t)( low % p );
+    first = low + ( rem ? p - rem : 0 );
+    if ( !( first & 1 ) )
+      first += p;
+    if ( (lmo_uint)p * p > first )
+      first = (lmo_uint)p * p;
+    if ( first - low >= (lmo_uint)count << 1 )
+      continue;
+
+    /* Odd multiples are one prime apart in the bitmap */
+    for ( k = (uint64_t)( first - low ) >> 1; k < count; k += p )
+    {
+      bits[ k >> 3 ] |= 1 << ( k & 7 );
+    }
+  }
+
+  primes_iterator_destroy( &it );
+}
+
+/**
+ * Parses the base and allocates the bitmaps of the parts
+ * @param s
+ */
+void window_create( struct state * s )
+{
+  struct window * w;
+  lmo_uint x, top;
+  uint64_t limit, lo, hi, mid, budget, bytes;
+  const char * source;
+  double total;
+  int i;
+
+  if ( !( w = s->window_mngr ) )
+    return;
+
+  if ( !lmo_parse( s->window_base, &x ) )
+    state_error( s, "Invalid number: %s", s->window_base );
+
+  /* Bit i stands for base + 2i + 1, the base is kept even */
+  w->start = x;
+  w->base = x & ~(lmo_uint)1;
+  w->count = (uint64_t)s->chunk_count * s->chunk_size * 8;
+  top = w->base + ( (lmo_uint)w->count << 1 );
+  if ( top > WINDOW_MAX )
+    state_error( s, "Window from %s ends above 1e20", s->window_base );
+
+  limit = lmo_isqrt( top ) + 1;
+
+  /* Every part needs a bitmap of the whole window */
+  budget = plan_budget( s, &source );
+  bytes = w->count >> 3;
+  w->part_count = s->thread_count;
+  if ( budget < PLAN_RESERVE || ( budget - PLAN_RESERVE ) / bytes < 1 )
+  {
+    state_error( s, "The window needs %llu bytes, %llu are available (%s)",
+                 (unsigned long long)( bytes + PLAN_RESERVE ),
+                 (unsigned long long)budget, source );
+  }
+  if ( ( budget - PLAN_RESERVE ) / bytes < (uint64_t)w->part_count )
+  {
+    w->part_count = (int)( ( budget - PLAN_RESERVE ) / bytes );
+    fprintf( stderr, "plan: sieving the window with %d threads in %llu "
+             "bytes (%s)\n", w->part_count, (unsigned long long)budget,
+             source );
+  }
+
+  /* Split the sieving primes into parts of equal estimated work */
+  assert( w->parts = (struct window_part*)malloc(
+      sizeof( struct window_part ) * w->part_count ) );
+  memset( w->parts, 0, sizeof( struct window_part ) * w->part_count );
+
+  total = window_cost( w->count, (double)limit );
+  for ( i = 0; i < w->part_count; ++i )
+  {
+    w->parts[ i ].state = s;
+    w->parts[ i ].from = i ? w->parts[ i - 1 ].to : 0;
+
+    lo = w->parts[ i ].from;
+    hi = limit;
+    while ( i + 1 < w->part_count && lo < hi )
+    {
+      mid = lo + ( hi - lo ) / 2;
+      if ( window_cost( w->count, (double)mid ) <
+           total * ( i + 1 ) / w->part_count )
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    w->parts[ i ].to = hi;
+
+    assert( w->parts[ i ].bits = (uint8_t*)malloc( w->count >> 3 ) );
+    memset( w->parts[ i ].bits, 0, w->count >> 3 );
+  }
+}
+
+/**
+ * Frees the bitmaps
+ * @param s
+ */
+void window_destroy( struct state * s )
+{
+  struct window * w;
+  int i;
+
+  if ( !( w = s->window_mngr ) )
+    return;
+
+  if ( w->parts )
+  {
+    for ( i = 0; i < w->part_count; ++i )
+    {
+      if ( w->parts[ i ].bits )
+        free( w->parts[ i ].bits );
+    }
+
+    free( w->parts );
+    w->parts = NULL;
+  }
+}
+
+/**
+ * Sieves the window and writes the offsets of its primes from the
+ * base to the output file as 64 bit numbers
+ * @param s
+ */
+void window_run( struct state * s )
+{
+  struct window * w;
+  uint64_t i, j, n, total, skip, * out;
+  uint64_t * word, * other;
+  lmo_uint first, last;
+  FILE * f;
+  int k;
+
+  if ( !( w = s->window_mngr ) )
+    return;
+
+  threads_map( s, w->parts, sizeof( struct window_part ), w->part_count,
+               window_sieve );
+
+  /* Merge the parts into the first one */
+  word = (uint64_t*)w->parts[ 0 ].bits;
+  for ( k = 1; k < w->part_count; ++k )
+  {
+    other = (uint64_t*)w->parts[ k ].bits;
+    for ( i = 0; i < ( w->count >> 6 ); ++i )
+      word[ i ] |= other[ i ];
+  }
+
+  if ( !( f = fopen( s->primes_file, "wb" ) ) )
+    state_error( s, "Cannot open %s", s->primes_file );
+
+  /* Offsets are counted from the requested base, which may be odd */
+  skip = (uint64_t)( w->start - w->base );
+  total = 0;
+  first = last = 0;
+
+  /* 1 is not a prime, 2 is the only even one */
+  if ( w->base == 0 )
+    w->parts[ 0 ].bits[ 0 ] |= 1;
+  if ( w->start <= 2 )
+  {
+    n = 2 - (uint64_t)w->start;
+    fwrite( &n, sizeof( n ), 1, f );
+    first = last = 2;
+    total++;
+  }
+
+  assert( out = (uint64_t*)malloc(
+      sizeof( uint64_t ) * ( KERNEL_BATCH + KERNEL_SLACK ) ) );
+
+  for ( i = 0; i < w->count; i += KERNEL_BATCH )
+  {
+    n = w->count - i < KERNEL_BATCH ? w->count - i : KERNEL_BATCH;
+    n = s->kernel->extract( w->parts[ 0 ].bits + ( i >> 3 ), i, n, out );
+
+    /* Bit 0 is the requested base itself if it is odd */
+    for ( j = 0; j < n; ++j )
+      out[ j ] -= skip;
+
+    if ( n )
+    {
+      if ( !total )
+        first = w->start + out[ 0 ];
+      last = w->start + out[ n - 1 ];
+      total += n;
+      fwrite( out, sizeof( uint64_t ), n, f );
+    }
+  }
+
+  free( out );
+  fclose( f );
+
+  if ( !s->quiet )
+  {
+    printf( "%llu primes in [", (unsigned long long)total );
+    lmo_print( stdout, w->start );
+    printf( ", " );
+    lmo_print( stdout, w->base + ( (lmo_uint)w->count << 1 ) );
+    printf( ")\n" );
+    if ( total )
+    {
+      printf( "first " );
+      lmo_print( stdout, first );
+      printf( ", last " );
+      lmo_print( stdout, last );
+      printf( "\n" );
+    }
+  }
+}
@@ -0,0 +1,76 @@
+/******************************************************************************
+The MIT License (MIT)
+
+Copyright (c) 2013 Nandor Licker, Daniel Simig
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+******************************************************************************/
+
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stdint.h>
+#include "lmo.h"
+
+/* Relative cost of finding the first multiple of a sieving prime with
+ * 128 bit arithmetic, in crossed out bits, used to balance the parts
+ */
+#define WINDOW_PRIME_COST 32.0
+
+/* End of the highest window, 1e20, sieved with the primes up to 1e10
+ * in about half a minute. The time grows with the root of the end
+ */
+#define WINDOW_MAX ( (lmo_uint)10000000000ull * 10000000000ull )
+
+struct state;
+
+struct window_part
+{
+  /* State shared by all parts */
+  struct state * state;
+
+  /* Sieving primes in [from, to) are handled by this part */
+  uint64_t from;
+  uint64_t to;
+
+  /* Private bitmap of the whole window */
+  uint8_t * bits;
+};
+
+struct window
+{
+  /* Number requested by --base, offsets are counted from it */
+  lmo_uint start;
+
+  /* Even number below the window, bit i stands for base + 2i + 1 */
+  lmo_uint base;
+
+  /* Number of bits in the window */
+  uint64_t count;
+
+  /* Parts sieved in parallel, merged into the bitmap of the first */
+  struct window_part * parts;
+  int part_count;
+};
+
+void window_create( struct state * );
+void window_destroy( struct state * );
+void window_run( struct state * );
+
+#endif